@@ -17,5 +17,7 @@ uint32_t crc32_acle(uint32_t crc, const unsigned char *buf, uint64_t len);
 
 void fill_window_arm(deflate_state *s);
 Pos insert_string_acle(deflate_state *const s, const Pos str, unsigned int count);
+z_size_t syncscan_neon(const unsigned char *buf, z_size_t len);
+z_size_t runscan_neon(const unsigned char *buf, z_size_t len);
 
 #endif
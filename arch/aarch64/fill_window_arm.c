@@ -63,7 +63,7 @@ void fill_window_arm(deflate_state *s) {
          * move the upper half to the lower one to make room in the upper half.
          */
         if (s->strstart >= wsize+MAX_DIST(s)) {
-            memcpy(s->window, s->window+wsize, wsize);
+            slide_window(s, wsize);
             s->match_start -= wsize;
             s->strstart    -= wsize; /* we now have strstart >= MAX_DIST */
             s->block_start -= wsize;
@@ -75,8 +75,14 @@ void fill_window_arm(deflate_state *s) {
                zlib, so we don't care about this pathological case.)
              */
 
+#ifdef POS32
+            slide_pos(s);
+#else
             slide_hash_chain(s->head, s->hash_size, wsize);
+            slide_hash_chain(s->head3, HASH3_SIZE, wsize);
             slide_hash_chain(s->prev, wsize, wsize);
+#endif
+            s->lazy_clear = 0;
             more += wsize;
         }
         if (s->strm->avail_in == 0)
@@ -102,22 +108,19 @@ void fill_window_arm(deflate_state *s) {
         if (s->lookahead + s->insert >= MIN_MATCH) {
             unsigned int str = s->strstart - s->insert;
             unsigned int insert_cnt = s->insert;
-            unsigned int slen;
 
             s->ins_h = s->window[str];
 
+            /* these strings may be hashed with bytes past the input */
+            if (s->insert)
+                s->lazy_clear = 0;
+            /* insert the same strings as fill_window_c() */
             if (unlikely(s->lookahead < MIN_MATCH))
-                insert_cnt += s->lookahead - MIN_MATCH;
-            slen = insert_cnt;
-            if (str >= (MIN_MATCH - 2))
-            {
-                str += 2 - MIN_MATCH;
-                insert_cnt += MIN_MATCH - 2;
-            }
+                insert_cnt += s->lookahead - (MIN_MATCH-1);
             if (insert_cnt > 0)
             {
                 insert_string_acle(s, str, insert_cnt);
-                s->insert -= slen;
+                s->insert -= insert_cnt;
             }
         }
         /* If the whole input has less than MIN_MATCH bytes, ins_h is garbage,
@@ -131,8 +134,9 @@ void fill_window_arm(deflate_state *s) {
      * the longest match routines.  Update the high water mark for the next
      * time through here.  WIN_INIT is set to MAX_MATCH since the longest match
      * routines allow scanning to strstart + MAX_MATCH, ignoring lookahead.
+     * A window in the input itself is never written.
      */
-    if (s->high_water < s->window_size) {
+    if (s->high_water < s->window_size && s->window == s->window_buf) {
         unsigned long curr = s->strstart + (unsigned long)s->lookahead;
         unsigned long init;
 
@@ -33,12 +33,13 @@ Pos insert_string_acle(deflate_state *const s, const Pos str, unsigned int count
 
     for (p = str; p <= lp; p++) {
         unsigned hm;
+        Pos pb = (Pos)(p + POS_BASE(s));
 
-        UPDATE_HASH_CRC_INTERNAL(s, hm, *(unsigned *)s->window[p]);
+        UPDATE_HASH_CRC_INTERNAL(s, hm, *(unsigned *)&s->window[p]);
 
-        if (s->head[hm] != p) {
+        if (s->head[hm] != pb) {
             s->prev[p & s->w_mask] = s->head[hm];
-            s->head[hm] = p;
+            s->head[hm] = pb;
             if (p == lp) {
                 ret = s->prev[lp & s->w_mask];
             }
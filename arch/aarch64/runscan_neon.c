@@ -0,0 +1,46 @@
+/* runscan_neon.c -- NEON version of the deflate_rle() run search
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ */
+
+#include "aarch64.h"
+#include "../../zutil.h"
+
+#ifdef _MSC_VER
+#include <arm64_neon.h>
+#else
+#include <arm_neon.h>
+#endif
+
+/* Return the offset of the first byte in buf[0..len-1] that starts a run of
+   three copies of the byte before it, or len if there is none. buf[-1] through
+   buf[len + 1] must be readable. Sixteen candidate positions are tested at
+   once by comparing the buffer at offsets -1, 0, 1 and 2 with their
+   neighbours. NEON has no movemask, so the compare result is narrowed to four
+   bits per byte to find the first run. */
+z_size_t ZLIB_INTERNAL runscan_neon(const unsigned char *buf, z_size_t len) {
+    uint8x16_t b0, b1, b2, b3;
+    uint64_t mask;
+    z_size_t i = 0;
+
+    while (len - i >= 16) {
+        b0 = vld1q_u8(buf + i - 1);
+        b1 = vld1q_u8(buf + i);
+        b2 = vld1q_u8(buf + i + 1);
+        b3 = vld1q_u8(buf + i + 2);
+        b0 = vandq_u8(vceqq_u8(b0, b1), vandq_u8(vceqq_u8(b1, b2), vceqq_u8(b2, b3)));
+
+        if (vmaxvq_u8(b0) != 0) {
+            mask = vget_lane_u64(vreinterpret_u64_u8(
+                       vshrn_n_u16(vreinterpretq_u16_u8(b0), 4)), 0);
+            return i + (__builtin_ctzll(mask) >> 2);
+        }
+        i += 16;
+    }
+
+    /* fewer than 16 bytes left */
+    for (; i < len; i++) {
+        if (buf[i - 1] == buf[i] && buf[i] == buf[i + 1] && buf[i + 1] == buf[i + 2])
+            return i;
+    }
+    return len;
+}
@@ -0,0 +1,45 @@
+/* syncscan_neon.c -- NEON version of the inflateSync() pattern search
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ */
+
+#include "aarch64.h"
+#include "../../zutil.h"
+
+#ifdef _MSC_VER
+#include <arm64_neon.h>
+#else
+#include <arm_neon.h>
+#endif
+
+/* Return the offset of the first 00 00 ff ff pattern in buf[0..len-1], or len
+   if there is none. Sixteen candidate positions are tested at once by comparing
+   the buffer at offsets 0, 1, 2 and 3 against the pattern bytes. NEON has no
+   movemask, so the compare result is narrowed to four bits per byte to find
+   the first match. */
+z_size_t ZLIB_INTERNAL syncscan_neon(const unsigned char *buf, z_size_t len) {
+    uint8x16_t b0, b1, b2, b3;
+    uint64_t mask;
+    z_size_t i = 0;
+
+    while (len - i >= 16 + 3) {
+        b0 = vceqzq_u8(vld1q_u8(buf + i));
+        b1 = vceqzq_u8(vld1q_u8(buf + i + 1));
+        b2 = vceqq_u8(vld1q_u8(buf + i + 2), vdupq_n_u8(0xff));
+        b3 = vceqq_u8(vld1q_u8(buf + i + 3), vdupq_n_u8(0xff));
+        b0 = vandq_u8(vandq_u8(b0, b1), vandq_u8(b2, b3));
+
+        if (vmaxvq_u8(b0) != 0) {
+            mask = vget_lane_u64(vreinterpret_u64_u8(
+                       vshrn_n_u16(vreinterpretq_u16_u8(b0), 4)), 0);
+            return i + (__builtin_ctzll(mask) >> 2);
+        }
+        i += 16;
+    }
+
+    /* fewer than 19 bytes left */
+    for (; len - i >= 4; i++) {
+        if (buf[i] == 0 && buf[i + 1] == 0 && buf[i + 2] == 0xff && buf[i + 3] == 0xff)
+            return i;
+    }
+    return len;
+}
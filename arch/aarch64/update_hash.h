@@ -6,12 +6,13 @@
 #include <arm_acle.h> // for __crc32w
 #endif
 
+#ifdef ZLIB_DETERMINISTIC
 #define UPDATE_HASH_CRC_INTERNAL(s, h, c) \
-	(h = __crc32w(0, \
-		((deflate_state *)s)->level >= 6 \
-		 ?  (c) & 0xFFFFFF \
-		 :  (c)) \
-	 & ((deflate_state *)s)->hash_mask)
+	UPDATE_HASH_MUL((deflate_state *)s, h, c)
+#else
+#define UPDATE_HASH_CRC_INTERNAL(s, h, c) \
+	(h = __crc32w(0, (c)) & ((deflate_state *)s)->hash_mask)
+#endif
 
 #define UPDATE_HASH(s, h, c) \
     UPDATE_HASH_CRC_INTERNAL(s, h, *(unsigned *)((uintptr_t)(&c) - (MIN_MATCH-1)))
@@ -263,7 +263,7 @@ local void partial_fold(z_const size_t len,
     *xmm_crc3 = _mm_castps_si128(ps_res);
 }
 
-ZLIB_INTERNAL void crc_fold_copy(unsigned *z_const s, unsigned char *dst, z_const unsigned char *src, size_t len) {
+ZLIB_INTERNAL void crc_fold_copy(unsigned *z_const s, unsigned char *dst, z_const unsigned char *src, long len) {
     unsigned long algn_diff;
     __m128i xmm_t0, xmm_t1, xmm_t2, xmm_t3;
     char zalign(16) partial_buf[16] = { 0 };
@@ -8,29 +8,26 @@
 #include <assert.h>
 #include <inttypes.h>
 
-#ifndef _MSC_VER
+#ifdef ZLIB_DETERMINISTIC
+#define UPDATE_HASH_CRC_INTERNAL(s, h, c) \
+	UPDATE_HASH_MUL((deflate_state * z_const)s, h, c)
+#elif !defined(_MSC_VER)
 #define UPDATE_HASH_CRC_INTERNAL(s,h,c) ( \
 {\
-    deflate_state *z_const state = (s);\
     unsigned val = (c); \
-    unsigned hash = 0;\
-    if (state->level >= 6) val &= 0xFFFFFF; \
-    __asm__ __volatile__ ("crc32 %1,%0\n\t" : "+r" (hash) : "r" (val) : ); \
-    h = hash & s->hash_mask; \
+    unsigned crc = 0;\
+    __asm__ __volatile__ ("crc32 %1,%0\n\t" : "+r" (crc) : "r" (val) : ); \
+    h = crc & (s)->hash_mask; \
 })
 #else
 #include <intrin.h>
 
 #define UPDATE_HASH_CRC_INTERNAL(s, h, c) \
-	(h = _mm_crc32_u32(0, \
-		((deflate_state * z_const)s)->level >= 6 \
-		 ?  (c) & 0xFFFFFF \
-		 :   (c)) \
-	 & ((deflate_state * z_const)s)->hash_mask)
+	(h = _mm_crc32_u32(0, (c)) & ((deflate_state * z_const)s)->hash_mask)
 #endif
 
 #define UPDATE_HASH(s,h,c) ( \
-    x86_cpu_has_sse42 ? UPDATE_HASH_CRC_INTERNAL(s, h, *(unsigned *)((uintptr_t)(&c) - (MIN_MATCH-1))) : UPDATE_HASH_C(s,h,c)\
+    LONG_HASH ? UPDATE_HASH_CRC_INTERNAL(s, h, *(unsigned *)((uintptr_t)(&c) - (MIN_MATCH-1))) : UPDATE_HASH_C(s,h,c)\
 ) 
 
 
@@ -45,7 +42,7 @@ INLINE Pos insert_string_sse(deflate_state *const s, const Pos str)
     UPDATE_HASH_CRC_INTERNAL(s, hm, *(unsigned *)&s->window[str]);
 
     ret = s->head[hm];
-    s->head[hm] = str;
+    s->head[hm] = (Pos)(str + POS_BASE(s));
     s->prev[str & s->w_mask] = ret;
     return ret;
 }
@@ -0,0 +1,42 @@
+/* runscan_sse2.c -- SSE2 version of the deflate_rle() run search
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ */
+
+#include "../../zconf.h"
+#include "../../zutil.h"
+
+#include <emmintrin.h>
+#include <stdint.h>
+
+/* Return the offset of the first byte in buf[0..len-1] that starts a run of
+   three copies of the byte before it, or len if there is none. buf[-1] through
+   buf[len + 1] must be readable. Sixteen candidate positions are tested at
+   once by comparing the buffer at offsets -1, 0, 1 and 2 with their
+   neighbours. */
+z_size_t ZLIB_INTERNAL runscan_sse2(const unsigned char *buf, z_size_t len) {
+    __m128i xmm_b0, xmm_b1, xmm_b2, xmm_b3;
+    unsigned mask;
+    z_size_t i = 0;
+
+    while (len - i >= 16) {
+        xmm_b0 = _mm_loadu_si128((__m128i *)(buf + i - 1));
+        xmm_b1 = _mm_loadu_si128((__m128i *)(buf + i));
+        xmm_b2 = _mm_loadu_si128((__m128i *)(buf + i + 1));
+        xmm_b3 = _mm_loadu_si128((__m128i *)(buf + i + 2));
+        xmm_b0 = _mm_and_si128(_mm_cmpeq_epi8(xmm_b0, xmm_b1),
+                               _mm_and_si128(_mm_cmpeq_epi8(xmm_b1, xmm_b2),
+                                             _mm_cmpeq_epi8(xmm_b2, xmm_b3)));
+
+        mask = (unsigned)_mm_movemask_epi8(xmm_b0);
+        if (mask != 0)
+            return i + (uint32_t)__builtin_ctzl(mask);
+        i += 16;
+    }
+
+    /* fewer than 16 bytes left */
+    for (; i < len; i++) {
+        if (buf[i - 1] == buf[i] && buf[i] == buf[i + 1] && buf[i + 1] == buf[i + 2])
+            return i;
+    }
+    return len;
+}
@@ -0,0 +1,39 @@
+/* syncscan_avx2.c -- AVX2 version of the inflateSync() pattern search
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ */
+
+#include "../../zconf.h"
+#include "../../zutil.h"
+
+#include <immintrin.h>
+#include <stdint.h>
+
+/* Return the offset of the first 00 00 ff ff pattern in buf[0..len-1], or len
+   if there is none. See syncscan_sse2(). */
+z_size_t ZLIB_INTERNAL syncscan_avx2(const unsigned char *buf, z_size_t len) {
+    const __m256i ymm_zero = _mm256_setzero_si256();
+    const __m256i ymm_ones = _mm256_set1_epi8(-1);
+    __m256i ymm_b0, ymm_b1, ymm_b2, ymm_b3;
+    unsigned mask;
+    z_size_t i = 0;
+
+    while (len - i >= 32 + 3) {
+        ymm_b0 = _mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i *)(buf + i)), ymm_zero);
+        ymm_b1 = _mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i *)(buf + i + 1)), ymm_zero);
+        ymm_b2 = _mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i *)(buf + i + 2)), ymm_ones);
+        ymm_b3 = _mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i *)(buf + i + 3)), ymm_ones);
+        ymm_b0 = _mm256_and_si256(_mm256_and_si256(ymm_b0, ymm_b1), _mm256_and_si256(ymm_b2, ymm_b3));
+
+        mask = (unsigned)_mm256_movemask_epi8(ymm_b0);
+        if (mask != 0)
+            return i + (uint32_t)__builtin_ctzl(mask);
+        i += 32;
+    }
+
+    /* fewer than 35 bytes left */
+    for (; len - i >= 4; i++) {
+        if (buf[i] == 0 && buf[i + 1] == 0 && buf[i + 2] == 0xff && buf[i + 3] == 0xff)
+            return i;
+    }
+    return len;
+}
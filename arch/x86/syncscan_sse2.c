@@ -0,0 +1,40 @@
+/* syncscan_sse2.c -- SSE2 version of the inflateSync() pattern search
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ */
+
+#include "../../zconf.h"
+#include "../../zutil.h"
+
+#include <emmintrin.h>
+#include <stdint.h>
+
+/* Return the offset of the first 00 00 ff ff pattern in buf[0..len-1], or len
+   if there is none. Sixteen candidate positions are tested at once by comparing
+   the buffer at offsets 0, 1, 2 and 3 against the pattern bytes. */
+z_size_t ZLIB_INTERNAL syncscan_sse2(const unsigned char *buf, z_size_t len) {
+    const __m128i xmm_zero = _mm_setzero_si128();
+    const __m128i xmm_ones = _mm_set1_epi8(-1);
+    __m128i xmm_b0, xmm_b1, xmm_b2, xmm_b3;
+    unsigned mask;
+    z_size_t i = 0;
+
+    while (len - i >= 16 + 3) {
+        xmm_b0 = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i *)(buf + i)), xmm_zero);
+        xmm_b1 = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i *)(buf + i + 1)), xmm_zero);
+        xmm_b2 = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i *)(buf + i + 2)), xmm_ones);
+        xmm_b3 = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i *)(buf + i + 3)), xmm_ones);
+        xmm_b0 = _mm_and_si128(_mm_and_si128(xmm_b0, xmm_b1), _mm_and_si128(xmm_b2, xmm_b3));
+
+        mask = (unsigned)_mm_movemask_epi8(xmm_b0);
+        if (mask != 0)
+            return i + (uint32_t)__builtin_ctzl(mask);
+        i += 16;
+    }
+
+    /* fewer than 19 bytes left */
+    for (; len - i >= 4; i++) {
+        if (buf[i] == 0 && buf[i + 1] == 0 && buf[i + 2] == 0xff && buf[i + 3] == 0xff)
+            return i;
+    }
+    return len;
+}
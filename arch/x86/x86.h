@@ -32,7 +32,7 @@ void ZLIB_INTERNAL crc_fold_init(unsigned* z_const s);
 void ZLIB_INTERNAL crc_fold_copy(unsigned* z_const s,
     unsigned char* dst,
     z_const unsigned char* src,
-    size_t len);
+    long len);
 void ZLIB_INTERNAL crc_fold(unsigned* z_const s,
     z_const unsigned char* src,
     size_t len);
@@ -65,4 +65,9 @@ extern uint8_t* chunkmemset_safe_avx(uint8_t* out, unsigned dist, unsigned len,
 ZLIB_INTERNAL uint32_t compare256_avx2(const uint8_t* src0, const uint8_t* src1);
 ZLIB_INTERNAL uint32_t compare256_sse2(const uint8_t* src0, const uint8_t* src1);
 
+z_size_t ZLIB_INTERNAL syncscan_sse2(const unsigned char* buf, z_size_t len);
+z_size_t ZLIB_INTERNAL syncscan_avx2(const unsigned char* buf, z_size_t len);
+
+z_size_t ZLIB_INTERNAL runscan_sse2(const unsigned char* buf, z_size_t len);
+
 #endif  /* X86_H */
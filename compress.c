@@ -6,7 +6,18 @@
 /* @(#) $Id$ */
 
 #define ZLIB_INTERNAL
-#include "zlib.h"
+#include "zutil.h"
+
+#ifndef _MSC_VER
+#  include <pthread.h>
+#else
+#  include <windows.h>
+#endif
+
+#ifndef BATCH_THREADS
+#  define BATCH_THREADS 64
+#endif
+/* most worker threads that compressBatch() starts */
 
 /* ===========================================================================
      Compresses the source buffer into the destination buffer. The level
@@ -84,3 +95,187 @@ uLong ZEXPORT compressBound(sourceLen)
     return sourceLen + (sourceLen >> 12) + (sourceLen >> 14) +
            (sourceLen >> 25) + 13;
 }
+
+/* ===========================================================================
+     Compress with level, and if that does not fit in destLen, compress again
+   with level 0, which only has the stored block headers on top of the data.
+ */
+int ZEXPORT compressFit(dest, destLen, source, sourceLen, level)
+    Bytef *dest;
+    uLongf *destLen;
+    const Bytef *source;
+    uLong sourceLen;
+    int level;
+{
+    uLong left = *destLen;
+    int err;
+
+    err = compress2(dest, destLen, source, sourceLen, level);
+    if (err == Z_BUF_ERROR && level != 0) {
+        *destLen = left;
+        err = compress2(dest, destLen, source, sourceLen, 0);
+    }
+    return err;
+}
+
+/* ===========================================================================
+     If the default memLevel or windowBits for deflateInit() is changed, then
+   this function needs to be updated: level 0 emits stored blocks of at least
+   32K bytes, five bytes of header each, plus the zlib wrapper.
+ */
+uLong ZEXPORT compressFitBound(sourceLen)
+    uLong sourceLen;
+{
+    return sourceLen + (sourceLen >> 15) * 5 + 5 + 6;
+}
+
+/* ===========================================================================
+     State shared by the workers of compressBatch(). Each worker has its own
+   deflate stream, and takes the next item from next until none is left, so
+   that items of different sizes keep all the workers busy.
+ */
+typedef struct batch_s {
+    Bytef * const *dest;
+    uLongf *destLen;
+    const Bytef * const *source;
+    const uLong *sourceLen;
+    int *err;
+    unsigned count;
+    int level;
+    volatile long next;         /* next item to take */
+} batch;
+
+typedef struct batch_worker_s {
+    batch *job;
+    int init;                   /* result of deflateInit() */
+    int ret;                    /* first error of the items, or Z_OK */
+} batch_worker;
+
+local void batch_work(w)
+    batch_worker *w;
+{
+    batch *job = w->job;
+    z_stream stream;
+    unsigned i;
+    int e;
+
+    stream.zalloc = (alloc_func)0;
+    stream.zfree = (free_func)0;
+    stream.opaque = (voidpf)0;
+    w->ret = Z_OK;
+    w->init = deflateInit(&stream, job->level);
+    if (w->init != Z_OK)
+        return;
+    for (;;) {
+#ifndef _MSC_VER
+        i = (unsigned)__sync_fetch_and_add(&job->next, 1);
+#else
+        i = (unsigned)InterlockedIncrement(&job->next) - 1;
+#endif
+        if (i >= job->count)
+            break;
+        e = deflateBatch(&stream, 1, job->dest + i, job->destLen + i,
+                         job->source + i, job->sourceLen + i,
+                         job->err == Z_NULL ? Z_NULL : job->err + i);
+        if (w->ret == Z_OK)
+            w->ret = e;
+    }
+    deflateEnd(&stream);
+}
+
+#ifndef _MSC_VER
+local void *batch_thread(arg)
+    void *arg;
+{
+    batch_work((batch_worker *)arg);
+    return NULL;
+}
+#else
+local DWORD WINAPI batch_thread(LPVOID arg)
+{
+    batch_work((batch_worker *)arg);
+    return 0;
+}
+#endif
+
+/* ===========================================================================
+     The calling thread is the first worker. If the other threads cannot be
+   started, it compresses their share itself.
+ */
+int ZEXPORT compressBatch(dest, destLen, source, sourceLen, count, level,
+                          threads, err)
+    Bytef * const *dest;
+    uLongf *destLen;
+    const Bytef * const *source;
+    const uLong *sourceLen;
+    unsigned count;
+    int level;
+    int threads;
+    int *err;
+{
+    batch job;
+    batch_worker worker[BATCH_THREADS];
+#ifndef _MSC_VER
+    pthread_t thread[BATCH_THREADS];
+#else
+    HANDLE thread[BATCH_THREADS];
+#endif
+    int n, started, ret;
+    unsigned i;
+
+    if (count == 0)
+        return Z_OK;
+    if (dest == Z_NULL || destLen == Z_NULL || source == Z_NULL ||
+        sourceLen == Z_NULL)
+        return Z_STREAM_ERROR;
+    job.dest = dest;
+    job.destLen = destLen;
+    job.source = source;
+    job.sourceLen = sourceLen;
+    job.err = err;
+    job.count = count;
+    job.level = level;
+    job.next = 0;
+
+    n = threads < 1 ? 1 : threads > BATCH_THREADS ? BATCH_THREADS : threads;
+    if ((unsigned)n > count)
+        n = (int)count;
+    for (started = 1; started < n; started++) {
+        worker[started].job = &job;
+#ifndef _MSC_VER
+        if (pthread_create(&thread[started], NULL, batch_thread,
+                           &worker[started]) != 0)
+            break;
+#else
+        thread[started] = CreateThread(NULL, 0, batch_thread,
+                                       &worker[started], 0, NULL);
+        if (thread[started] == NULL)
+            break;
+#endif
+    }
+    worker[0].job = &job;
+    batch_work(&worker[0]);
+
+    ret = worker[0].ret;
+    for (n = 1; n < started; n++) {
+#ifndef _MSC_VER
+        pthread_join(thread[n], NULL);
+#else
+        WaitForSingleObject(thread[n], INFINITE);
+        CloseHandle(thread[n]);
+#endif
+        if (ret == Z_OK)
+            ret = worker[n].ret;
+    }
+
+    /* items are only left if no worker could allocate its stream */
+    if ((unsigned)job.next < count) {
+        ret = worker[0].init;
+        for (i = (unsigned)job.next; i < count; i++) {
+            destLen[i] = 0;
+            if (err != Z_NULL)
+                err[i] = ret;
+        }
+    }
+    return ret;
+}
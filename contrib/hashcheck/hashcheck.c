@@ -0,0 +1,162 @@
+/* hashcheck.c -- check that deflate output does not depend on the CPU
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ *
+ * Compresses generated data over all levels and strategies, with several
+ * windowBits, memLevel and flush patterns, and prints a CRC-32 digest of all
+ * of the compressed output.
+ *
+ * With ZLIB_DETERMINISTIC defined for this file and the library, the digest
+ * is compared with EXPECTED, the digest from an x86-64 build, and the
+ * program fails if it differs.  Running it on each CPU and architecture,
+ * x86 with and without AVX2 as well as ARM64, checks that they all give
+ * the same output.
+ *
+ * Without ZLIB_DETERMINISTIC, the x86 build also compresses the cases again
+ * with the SSE4.2 hash turned off, to show that the output then differs.
+ * That needs x86_cpu_has_sse42, so build it together with the zlib sources
+ * rather than against the DLL.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "zlib.h"
+#if !defined(ZLIB_DETERMINISTIC) && (defined(_M_IX86) || defined(_M_AMD64))
+#  include "arch/x86/x86.h"
+#endif
+
+#define DATA_LEN (1L << 18)
+#define CHUNK    16384
+
+#ifdef ZLIB_DETERMINISTIC
+#  define EXPECTED 0xe1342f4eUL
+#endif
+
+static unsigned long seed;
+
+static unsigned next_rand OF((void));
+static void make_data OF((unsigned char *buf, unsigned long len, int kind));
+static uLong digest OF((const unsigned char *data, unsigned char *out,
+                        uLong outLen));
+
+static unsigned next_rand()
+{
+    seed = seed * 1103515245UL + 12345UL;
+    return (unsigned)(seed >> 16) & 0x7fff;
+}
+
+/* ===========================================================================
+ * Fill buf with text-like data (kind 0), binary data with repeats at random
+ * distances (kind 1), or random bytes (kind 2).
+ */
+static void make_data(buf, len, kind)
+    unsigned char *buf;
+    unsigned long len;
+    int kind;
+{
+    unsigned long i, dist;
+
+    for (i = 0; i < len; i++) {
+        if (kind != 2 && i > 300 && next_rand() % 4 == 0) {
+            dist = 1 + next_rand() % (i < 30000 ? i : 30000);
+            buf[i] = buf[i - dist];
+        }
+        else if (kind == 0 && next_rand() % 8 == 0)
+            buf[i] = ' ';
+        else if (kind == 0)
+            buf[i] = (unsigned char)('a' + next_rand() % 26);
+        else
+            buf[i] = (unsigned char)next_rand();
+    }
+}
+
+/* ===========================================================================
+ * Compress data in every case and return the CRC-32 of all of the output.
+ * Return 0 and report the case if deflate() fails.
+ */
+static uLong digest(data, out, outLen)
+    const unsigned char *data;
+    unsigned char *out;
+    uLong outLen;
+{
+    static const int wbits[] = {15, -10, 31, 9};
+    static const int mem[] = {8, 3, 9, 1};
+    uLong crc = crc32(0L, Z_NULL, 0);
+    int kind, level, strategy, v, flush, ret;
+    unsigned long pos, take;
+    z_stream strm;
+
+    for (kind = 0; kind < 3; kind++)
+    for (level = 0; level <= 9; level++)
+    for (strategy = Z_DEFAULT_STRATEGY; strategy <= Z_FIXED; strategy++)
+    for (v = 0; v < 4; v++) {
+        seed = (unsigned long)v;
+        memset(&strm, 0, sizeof(strm));
+        if (deflateInit2(&strm, level, Z_DEFLATED, wbits[v], mem[v],
+                         strategy) != Z_OK)
+            return 0;
+        for (pos = 0; pos < DATA_LEN; pos += take) {
+            take = v ? 1 + next_rand() * 2UL : DATA_LEN;
+            if (take > DATA_LEN - pos)
+                take = DATA_LEN - pos;
+            flush = pos + take == DATA_LEN ? Z_FINISH :
+                    v == 2 && next_rand() % 4 == 0 ? Z_SYNC_FLUSH :
+                    Z_NO_FLUSH;
+            strm.next_in = (z_const Bytef *)data + kind * DATA_LEN + pos;
+            strm.avail_in = (uInt)take;
+            do {
+                strm.next_out = out;
+                strm.avail_out = (uInt)outLen;
+                ret = deflate(&strm, flush);
+                if (ret == Z_STREAM_ERROR) {
+                    fprintf(stderr, "deflate error: level %d strategy %d "
+                            "windowBits %d\n", level, strategy, wbits[v]);
+                    deflateEnd(&strm);
+                    return 0;
+                }
+                crc = crc32(crc, out, (uInt)(outLen - strm.avail_out));
+            } while (strm.avail_out == 0);
+        }
+        deflateEnd(&strm);
+    }
+    return crc;
+}
+
+int main()
+{
+    unsigned char *data, *out;
+    uLong crc;
+    int kind;
+
+    data = (unsigned char *)malloc(3 * DATA_LEN);
+    out = (unsigned char *)malloc(CHUNK);
+    if (data == NULL || out == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    seed = 1;
+    for (kind = 0; kind < 3; kind++)
+        make_data(data + kind * DATA_LEN, DATA_LEN, kind);
+
+    crc = digest(data, out, CHUNK);
+    printf("digest %08lx\n", crc);
+#ifdef ZLIB_DETERMINISTIC
+    if (crc != EXPECTED) {
+        printf("expected %08lx\n", EXPECTED);
+        crc = 0;
+    }
+#elif defined(_M_IX86) || defined(_M_AMD64)
+    if (crc != 0 && x86_cpu_has_sse42) {
+        uLong crc_c;
+
+        /* deflateInit2() has checked the features, so this sticks */
+        x86_cpu_has_sse42 = 0;
+        crc_c = digest(data, out, CHUNK);
+        printf("digest %08lx without SSE4.2: %s\n", crc_c,
+               crc_c == crc ? "same" : "differs");
+    }
+#endif
+    free(out);
+    free(data);
+    return crc == 0;
+}
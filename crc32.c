@@ -549,3 +549,14 @@ ZLIB_INTERNAL void copy_with_crc(z_streamp strm, Bytef *dst, long size)
     zmemcpy(dst, strm->next_in, size);
     strm->adler = crc32(strm->adler, dst, size);
 }
+
+ZLIB_INTERNAL void crc_in_place(z_streamp strm, z_const Bytef *buf, long size)
+{
+#if defined(USE_PCLMUL_CRC)
+    if (x86_cpu_has_pclmul) {
+        crc_fold(strm->state->crc0, buf, size);
+        return;
+    }
+#endif
+    strm->adler = crc32(strm->adler, buf, size);
+}
@@ -49,6 +49,10 @@
 
 /* @(#) $Id$ */
 
+#include <time.h>
+#ifdef _MSC_VER
+#  include <windows.h>
+#endif
 #include "deflate.h"
 #if defined(_M_IX86) || defined(_M_AMD64)
 #include "arch/x86/x86.h"
@@ -82,20 +86,38 @@ typedef block_state (*compress_func) OF((deflate_state *s, int flush));
 /* Compression function. Returns the block state after the call. */
 
 local int deflateStateCheck      OF((z_streamp strm));
+#ifndef POS32
+local void slide_hash3    OF((deflate_state *s));
+#endif
 local void slide_hash     OF((deflate_state *s));
 local void fill_window    OF((deflate_state *s));
 local block_state deflate_stored OF((deflate_state *s, int flush));
+local block_state deflate_stored_run OF((deflate_state *s, int flush));
 local block_state deflate_fast   OF((deflate_state *s, int flush));
 #ifndef FASTEST
 local block_state deflate_slow   OF((deflate_state *s, int flush));
+local void adapt_chain    OF((deflate_state *s));
 #endif
 local block_state deflate_rle    OF((deflate_state *s, int flush));
 local block_state deflate_huff   OF((deflate_state *s, int flush));
+local z_size_t runscan     OF((const Bytef *buf, z_size_t len));
+local void reset_hash     OF((deflate_state *s));
 local void lm_init        OF((deflate_state *s));
+local int  settle_lazy    OF((deflate_state *s));
+local void zero_copy_start OF((deflate_state *s, int flush));
+local void zero_copy_end  OF((deflate_state *s));
 local void putShortMSB    OF((deflate_state *s, uInt b));
 local void flush_pending  OF((z_streamp strm));
+local uInt rsync_scan     OF((deflate_state *s, const Bytef *buf, uInt len));
+local int  rate_rung      OF((int level, int strategy));
+local ulg  rate_time      OF((void));
+local void rate_measure   OF((z_streamp strm, ulg usec));
+local void rate_params    OF((z_streamp strm));
+local int  deflate_item   OF((z_streamp strm, Bytef *dest, uLongf *destLen,
+                              const Bytef *source, uLong sourceLen));
 
 local uInt longest_match  OF((deflate_state *s, IPos cur_match));
+local uInt short_match    OF((deflate_state *s, uInt best_len));
 
 #ifdef ZLIB_DEBUG
 local  void check_match OF((deflate_state *s, IPos start, IPos match,
@@ -109,6 +131,7 @@ ZLIB_INTERNAL unsigned read_buf OF((z_streamp strm, Bytef *buf, unsigned size));
 extern void ZLIB_INTERNAL crc_reset(deflate_state *const s);
 extern void ZLIB_INTERNAL crc_finalize(deflate_state *const s);
 extern void ZLIB_INTERNAL copy_with_crc(z_streamp strm, Bytef *dst, long size);
+extern void ZLIB_INTERNAL crc_in_place(z_streamp strm, z_const Bytef *buf, long size);
 
 /* ===========================================================================
  * Local data
@@ -122,6 +145,42 @@ extern void ZLIB_INTERNAL copy_with_crc(z_streamp strm, Bytef *dst, long size);
 #endif
 /* Matches of length 3 are discarded if their distance exceeds TOO_FAR */
 
+#ifndef LAZY_CLEAR_SHIFT
+#  define LAZY_CLEAR_SHIFT 5
+#endif
+/* A reset clears the buckets of the strings of the last input one by one if
+ * that input had at most hash_size >> LAZY_CLEAR_SHIFT bytes */
+
+#ifndef RATE_MS
+#  define RATE_MS 50
+#endif
+/* deflateRate() moves on the level ladder after every RATE_MS milliseconds of
+ * compression */
+
+#ifdef FASTEST
+#  define RATE_TOP 3
+#else
+#  define RATE_TOP 11
+#endif
+/* Top rung of the level ladder: level 0, Z_HUFFMAN_ONLY, Z_RLE, levels 1.. */
+
+#ifndef CHAIN_PERIOD
+#  define CHAIN_PERIOD 4096
+#endif
+/* deflate_slow() adapts chain_limit after every CHAIN_PERIOD searches */
+
+#ifndef CHAIN_BUDGET
+#  define CHAIN_BUDGET 16
+#endif
+/* Chain steps per search past the first quarter of the chain that are spent
+ * before chain_limit is lowered, if they gain less than a match byte per 256
+ * steps */
+
+#ifndef CHAIN_FLOOR_SHIFT
+#  define CHAIN_FLOOR_SHIFT 4
+#endif
+/* chain_limit is not lowered below max_chain_length >> CHAIN_FLOOR_SHIFT */
+
 /* Values for max_lazy_match, good_match and max_chain_length, depending on
  * the desired pack level (0..9). The values given below have been tuned to
  * exclude worst case performance for pathological files. Better values may be
@@ -164,6 +223,25 @@ local const config configuration_table[10] = {
 /* rank Z_BLOCK between Z_NO_FLUSH and Z_PARTIAL_FLUSH */
 #define RANK(f) (((f) * 2) - ((f) > 4 ? 9 : 0))
 
+/* the function that deflate() compresses with for a level and strategy */
+#define COMPRESS_FUNC(level, strategy) \
+    ((level) == 0 ? deflate_stored : \
+     (strategy) == Z_HUFFMAN_ONLY ? deflate_huff : \
+     (strategy) == Z_RLE ? deflate_rle : configuration_table[level].func)
+
+/* Whether insert_string() hashes four bytes, in which case deflate_slow()
+ * looks up 3-byte matches separately with short_match(), and
+ * longest_match_slow() only switches to hash chains that are keyed on bytes
+ * of the current match. ZLIB_DETERMINISTIC uses the four byte hash on all
+ * CPUs.
+ */
+#if defined(ZLIB_DETERMINISTIC) || defined(_M_ARM64)
+#  define LONG_HASH 1
+#elif defined(_M_IX86) || defined(_M_AMD64)
+#  define LONG_HASH x86_cpu_has_sse42
+#else
+#  define LONG_HASH 0
+#endif
 
 /* ===========================================================================
  * Insert string str in the dictionary and set match_head to the previous head
@@ -179,13 +257,13 @@ local INLINE Pos insert_string_c(deflate_state *const s, const Pos str)
 {
     Pos ret;
 
-    UPDATE_HASH_C(s, s->ins_h, str);
+    UPDATE_HASH_C(s, s->ins_h, s->window[str + (MIN_MATCH-1)]);
 #ifdef FASTEST
     ret = s->head[s->ins_h];
 #else
     ret = s->prev[str & s->w_mask] = s->head[s->ins_h];
 #endif
-    s->head[s->ins_h] = str;
+    s->head[s->ins_h] = (Pos)(str + POS_BASE(s));
 
     return ret;
 }
@@ -193,7 +271,7 @@ local INLINE Pos insert_string_c(deflate_state *const s, const Pos str)
 local INLINE Pos insert_string(deflate_state *const s, const Pos str)
 {
 #if defined(_M_IX86) || defined(_M_AMD64)
-    if (x86_cpu_has_sse42) {
+    if (LONG_HASH) {
         return insert_string_sse(s, str);
     }
 #elif defined(_M_ARM64)
@@ -211,17 +289,40 @@ local INLINE Pos insert_string(deflate_state *const s, const Pos str)
         s->head[s->hash_size - 1] = NIL; \
         zmemzero((Bytef *)s->head, \
                  (unsigned)(s->hash_size - 1)*sizeof(*s->head)); \
+        zmemzero((Bytef *)s->head3, HASH3_SIZE*sizeof(*s->head3)); \
     } while (0)
 
+#ifndef POS32
 /* ===========================================================================
- * Slide the hash table when sliding the window down (could be avoided with 32
- * bit values at the expense of memory usage). We slide even when level == 0 to
- * keep the hash table consistent if we switch back to level > 0 later.
+ * Slide head3[] down by w_size. It is small enough not to need SIMD.
+ */
+local void slide_hash3(s)
+    deflate_state *s;
+{
+    unsigned n, m;
+    Posf *p;
+    uInt wsize = s->w_size;
+
+    n = HASH3_SIZE;
+    p = &s->head3[n];
+    do {
+        m = *--p;
+        *p = (Pos)(m >= wsize ? m - wsize : NIL);
+    } while (--n);
+}
+#endif
+
+/* ===========================================================================
+ * Slide the hash table when sliding the window down (avoided with POS32 at
+ * the expense of memory usage). We slide even when level == 0 to keep the
+ * hash table consistent if we switch back to level > 0 later.
  */
 local void slide_hash(s)
     deflate_state *s;
 {
-#if defined(_M_IX86) || defined(_M_AMD64)
+#if defined(POS32)
+    slide_pos(s);
+#elif defined(_M_IX86) || defined(_M_AMD64)
     //x86_check_features();
 /* Disabled until we have all avx2 enabled
     if (x86_cpu_has_avx2)
@@ -231,11 +332,13 @@ local void slide_hash(s)
     }
 */
     slide_hash_sse2(s);
+    slide_hash3(s);
 #else
     unsigned n, m;
     Posf *p;
     uInt wsize = s->w_size;
 
+    slide_hash3(s);
     n = s->hash_size;
     p = &s->head[n];
     do {
@@ -256,6 +359,48 @@ local void slide_hash(s)
 #endif
 }
 
+#ifdef POS32
+/* ===========================================================================
+ * Slide the 32-bit positions in head[] and prev[] down by w_size. This only
+ * adds w_size to pos_base, except when pos_base reaches POS_REBASE: then the
+ * positions are rebased to window indices, and the positions that were slid
+ * out of the window become NIL.
+ */
+void ZLIB_INTERNAL slide_pos(s)
+    deflate_state *s;
+{
+    unsigned n;
+    Pos m, base;
+    Posf *p;
+
+    s->pos_base += s->w_size;
+    if (s->pos_base < POS_REBASE)
+        return;
+    base = s->pos_base;
+    n = s->hash_size;
+    p = &s->head[n];
+    do {
+        m = *--p;
+        *p = m > base ? m - base : NIL;
+    } while (--n);
+    n = HASH3_SIZE;
+    p = &s->head3[n];
+    do {
+        m = *--p;
+        *p = m > base ? m - base : NIL;
+    } while (--n);
+#ifndef FASTEST
+    n = s->w_size;
+    p = &s->prev[n];
+    do {
+        m = *--p;
+        *p = m > base ? m - base : NIL;
+    } while (--n);
+#endif
+    s->pos_base = 0;
+}
+#endif
+
 /* ========================================================================= */
 int ZEXPORT deflateInit_(strm, level, version, stream_size)
     z_streamp strm;
@@ -280,9 +425,9 @@ int ZEXPORT deflateInit2_(strm, level, method, windowBits, memLevel, strategy,
     const char *version;
     int stream_size;
 {
-    unsigned window_padding = 8;
     deflate_state *s;
     int wrap = 1;
+    int rsyncable;
     static const char my_version[] = ZLIB_VERSION;
 
     ushf *overlay;
@@ -333,6 +478,8 @@ int ZEXPORT deflateInit2_(strm, level, method, windowBits, memLevel, strategy,
         windowBits -= 16;
     }
 #endif
+    rsyncable = strategy & Z_RSYNCABLE;
+    strategy &= ~Z_RSYNCABLE;
     if (memLevel < 1 || memLevel > MAX_MEM_LEVEL || method != Z_DEFLATED ||
         windowBits < 8 || windowBits > 15 || level < 0 || level > 9 ||
         strategy < 0 || strategy > Z_FIXED || (windowBits == 8 && wrap != 1)) {
@@ -356,7 +503,7 @@ int ZEXPORT deflateInit2_(strm, level, method, windowBits, memLevel, strategy,
 #else
 #if defined(_M_IX86) || defined(_M_AMD64)
     // for insert_string_sse which uses the crc32 instruction 
-    if (x86_cpu_has_sse42) {
+    if (LONG_HASH) {
         s->hash_bits = 15;
     } else 
 #endif
@@ -369,34 +516,41 @@ int ZEXPORT deflateInit2_(strm, level, method, windowBits, memLevel, strategy,
     s->hash_mask = s->hash_size - 1;
     s->hash_shift =  ((s->hash_bits + MIN_MATCH-1) / MIN_MATCH);
 
-    s->window = (Bytef *) ZALLOC(strm, s->w_size + window_padding, 2*sizeof(Byte));
+    s->window = (Bytef *) ZALLOC(strm, s->w_size + WIN_PAD/2, 2*sizeof(Byte));
+    s->window_buf = s->window;
     s->prev   = (Posf *)  ZALLOC(strm, s->w_size, sizeof(Pos));
     s->head   = (Posf *)  ZALLOC(strm, s->hash_size, sizeof(Pos));
+    s->head3  = (Posf *)  ZALLOC(strm, HASH3_SIZE, sizeof(Pos));
 
     s->high_water = 0;      /* nothing written to s->window yet */
+    s->lazy_clear = 0;      /* head[] is not initialized yet */
 
     s->lit_bufsize = 1 << (memLevel + 6); /* 16K elements by default */
 
-    overlay = (ushf *) ZALLOC(strm, s->lit_bufsize, sizeof(ush)+2);
+    overlay = (ushf *) ZALLOC(strm, s->lit_bufsize, LIT_BUFS);
     s->pending_buf = (uchf *) overlay;
-    s->pending_buf_size = (ulg)s->lit_bufsize * (sizeof(ush)+2L);
+    s->pending_buf_size = (ulg)s->lit_bufsize * 4;
 
     if (s->window == Z_NULL || s->prev == Z_NULL || s->head == Z_NULL ||
-        s->pending_buf == Z_NULL) {
+        s->head3 == Z_NULL || s->pending_buf == Z_NULL) {
         s->status = FINISH_STATE;
         strm->msg = ERR_MSG(Z_MEM_ERROR);
         deflateEnd (strm);
         return Z_MEM_ERROR;
     }
-    s->sym_buf = s->pending_buf + s->lit_bufsize;
-    s->sym_end = (s->lit_bufsize - 1) * 3;
-    /* We avoid equality with lit_bufsize*3 because of wraparound at 64K
+    s->sym_buf = (uint32_t *)(s->pending_buf + s->lit_bufsize);
+    s->sym_end = s->lit_bufsize - 1;
+    /* We avoid equality with lit_bufsize because of wraparound at 64K
      * on 16 bit machines and because stored blocks are restricted to
      * 64K-1 bytes.
      */
 
     s->level = level;
     s->strategy = strategy;
+    s->rsyncable = rsyncable != 0;
+    s->rate = 0;
+    s->rate_strategy = strategy == Z_HUFFMAN_ONLY || strategy == Z_RLE ?
+                       Z_DEFAULT_STRATEGY : strategy;
     s->method = (Byte)method;
 
     return deflateReset(strm);
@@ -450,6 +604,7 @@ int ZEXPORT deflateSetDictionary(strm, dictionary, dictLength)
     if (wrap == 1)
         strm->adler = adler32(strm->adler, dictionary, dictLength);
     s->wrap = 0;                    /* avoid computing Adler-32 in read_buf */
+    s->lazy_clear = 0;
 
     /* if dictionary would fill window, just replace the history */
     if (dictLength >= s->w_size) {
@@ -514,6 +669,94 @@ int ZEXPORT deflateGetDictionary(strm, dictionary, dictLength)
     return Z_OK;
 }
 
+/* ========================================================================= */
+int ZEXPORT deflatePrepareDictionary(strm, dictionary, dictLength, dict)
+    z_streamp strm;
+    const Bytef *dictionary;
+    uInt  dictLength;
+    z_dictp *dict;
+{
+    deflate_state *s;
+    z_dictp d;
+    uLong dictid;
+    ulg tables;
+    int ret;
+
+    if (deflateStateCheck(strm) || dictionary == Z_NULL || dict == Z_NULL)
+        return Z_STREAM_ERROR;
+    s = strm->state;
+    if (s->strstart || s->lookahead)
+        return Z_STREAM_ERROR;
+    dictid = adler32(adler32(0L, Z_NULL, 0), dictionary, dictLength);
+    ret = deflateSetDictionary(strm, dictionary, dictLength);
+    if (ret != Z_OK)
+        return ret;
+
+    /* save the state that deflateSetDictionary() built from an empty window */
+    tables = ((ulg)s->hash_size + s->strstart) * sizeof(Pos);
+    d = (z_dictp) ZALLOC(strm, 1, (uInt)(sizeof(*d) + tables + s->strstart));
+    if (d == Z_NULL)
+        return Z_MEM_ERROR;
+    d->dictid = dictid;
+    d->length = s->strstart;
+    d->w_bits = s->w_bits;
+    d->hash_bits = s->hash_bits;
+    d->head = (voidpf)(d + 1);
+    d->prev = (voidpf)((Posf *)d->head + s->hash_size);
+    d->window = (Bytef *)d->head + tables;
+    d->ins_h = s->ins_h;
+    d->insert = s->insert;
+    d->zfree = strm->zfree;
+    d->opaque = strm->opaque;
+    zmemcpy(d->head, (voidpf)s->head, s->hash_size * sizeof(Pos));
+    zmemcpy(d->prev, (voidpf)s->prev, d->length * sizeof(Pos));
+    zmemcpy(d->window, s->window, d->length);
+    *dict = d;
+    return Z_OK;
+}
+
+/* ========================================================================= */
+int ZEXPORT deflateSetPreparedDictionary(strm, dict)
+    z_streamp strm;
+    z_dictp dict;
+{
+    deflate_state *s;
+
+    if (deflateStateCheck(strm) || dict == Z_NULL)
+        return Z_STREAM_ERROR;
+    s = strm->state;
+    if (s->wrap == 2 || (s->wrap == 1 && s->status != INIT_STATE) ||
+        s->strstart || s->lookahead || dict->w_bits != s->w_bits ||
+        dict->hash_bits != s->hash_bits)
+        return Z_STREAM_ERROR;
+
+    if (s->wrap == 1)
+        strm->adler = dict->dictid;
+    zmemcpy((voidpf)s->head, dict->head, s->hash_size * sizeof(Pos));
+    zmemcpy((voidpf)s->prev, dict->prev, dict->length * sizeof(Pos));
+    zmemcpy(s->window, dict->window, dict->length);
+    s->lazy_clear = 0;
+    if (s->high_water < dict->length)
+        s->high_water = dict->length;
+    s->strstart = dict->length;
+    s->block_start = (long)s->strstart;
+    s->insert = dict->insert;
+    s->ins_h = dict->ins_h;
+    s->match_length = s->prev_length = MIN_MATCH-1;
+    s->match_available = 0;
+    return Z_OK;
+}
+
+/* ========================================================================= */
+int ZEXPORT deflateFreeDictionary(dict)
+    z_dictp dict;
+{
+    if (dict == Z_NULL)
+        return Z_STREAM_ERROR;
+    (*dict->zfree)(dict->opaque, (voidpf)dict);
+    return Z_OK;
+}
+
 /* ========================================================================= */
 int ZEXPORT deflateResetKeep(strm)
     z_streamp strm;
@@ -546,6 +789,12 @@ int ZEXPORT deflateResetKeep(strm)
 #endif
         adler32(0L, Z_NULL, 0);
     s->last_flush = -2;
+    s->rsync_hash = 0;
+    s->rsync_run = 0;
+    s->rsync_seen = 0;
+    s->rsync_hit = 0;
+    s->rate_usec = 0;
+    s->rate_in = s->rate_out = 0;
 
     _tr_init(s);
 
@@ -601,13 +850,13 @@ int ZEXPORT deflatePrime(strm, bits, value)
     if (deflateStateCheck(strm)) return Z_STREAM_ERROR;
     s = strm->state;
     if (bits < 0 || bits > 16 ||
-        s->sym_buf < s->pending_out + ((Buf_size + 7) >> 3))
+        (uchf *)s->sym_buf < s->pending_out + ((Buf_size + 7) >> 3))
         return Z_BUF_ERROR;
     do {
         put = Buf_size - s->bi_valid;
         if (put > bits)
             put = bits;
-        s->bi_buf |= (ush)((value & ((1 << put) - 1)) << s->bi_valid);
+        s->bi_buf |= (uint64_t)(value & ((1 << put) - 1)) << s->bi_valid;
         s->bi_valid += put;
         _tr_flush_bits(s);
         value >>= put;
@@ -623,7 +872,8 @@ int ZEXPORT deflateParams(strm, level, strategy)
     int strategy;
 {
     deflate_state *s;
-    compress_func func;
+    compress_func func, next;
+    int rsyncable;
 
     if (deflateStateCheck(strm)) return Z_STREAM_ERROR;
     s = strm->state;
@@ -633,19 +883,49 @@ int ZEXPORT deflateParams(strm, level, strategy)
 #else
     if (level == Z_DEFAULT_COMPRESSION) level = 6;
 #endif
+    rsyncable = (strategy & Z_RSYNCABLE) != 0;
+    strategy &= ~Z_RSYNCABLE;
     if (level < 0 || level > 9 || strategy < 0 || strategy > Z_FIXED) {
         return Z_STREAM_ERROR;
     }
-    func = configuration_table[s->level].func;
-
-    if ((strategy != s->strategy || func != configuration_table[level].func) &&
-        s->last_flush != -2) {
-        /* Flush the last buffer: */
-        int err = deflate(strm, Z_BLOCK);
-        if (err == Z_STREAM_ERROR)
-            return err;
-        if (strm->avail_in || (s->strstart - s->block_start) + s->lookahead)
-            return Z_BUF_ERROR;
+    func = COMPRESS_FUNC(s->level, s->strategy);
+    next = COMPRESS_FUNC(level, strategy);
+
+    if (func != next && s->last_flush != -2) {
+        /* The LZ functions share the hash table and the symbol buffer, so the
+         * current block is simply continued by the next one. deflate_stored()
+         * and deflate_huff() need a block of their own, and deflate_rle()
+         * cannot store the input that deflate_fast() or deflate_slow() found
+         * to be incompressible.
+         */
+        if (func == deflate_stored || next == deflate_stored ||
+            func == deflate_huff || next == deflate_huff ||
+            (next == deflate_rle && s->incompressible) || !settle_lazy(s)) {
+            /* Flush the last buffer: */
+            int err = deflate(strm, Z_BLOCK);
+            if (err == Z_STREAM_ERROR)
+                return err;
+            if (strm->avail_in || (s->strstart - s->block_start) + s->lookahead)
+                return Z_BUF_ERROR;
+            if (next == deflate_stored || next == deflate_huff ||
+                next == deflate_rle)
+                s->incompressible = 0;
+        }
+        s->lazy_clear = 0;
+        /* deflate_slow() leaves prev_length at 0 after a match, which
+         * deflate_fast() would take as the length to beat */
+        s->prev_length = s->match_length = MIN_MATCH-1;
+#if !defined(_M_ARM64)
+        /* deflate_stored(), deflate_huff() and deflate_rle() do not keep the
+         * rolling hash of the strings they pass over */
+        if (!LONG_HASH && s->lookahead >= MIN_MATCH-1) {
+            s->ins_h = s->window[s->strstart];
+            UPDATE_HASH_C(s, s->ins_h, s->window[s->strstart + 1]);
+#if MIN_MATCH != 3
+            Call UPDATE_HASH() MIN_MATCH-3 more times
+#endif
+        }
+#endif
     }
     if (s->level != level) {
         if (s->level == 0 && s->matches != 0) {
@@ -660,8 +940,18 @@ int ZEXPORT deflateParams(strm, level, strategy)
         s->good_match       = configuration_table[level].good_length;
         s->nice_match       = configuration_table[level].nice_length;
         s->max_chain_length = configuration_table[level].max_chain;
+        s->chain_limit      = s->max_chain_length;
+        s->chain_calls = s->chain_work = s->chain_gain = 0;
     }
     s->strategy = strategy;
+    if (strategy != Z_HUFFMAN_ONLY && strategy != Z_RLE)
+        s->rate_strategy = strategy;
+    s->rate_rung = rate_rung(level, strategy);
+    if (s->rsyncable != rsyncable) {
+        s->rsyncable = rsyncable;
+        s->rsync_seen = 0;
+        s->rsync_hit = 0;
+    }
     return Z_OK;
 }
 
@@ -681,6 +971,25 @@ int ZEXPORT deflateTune(strm, good_length, max_lazy, nice_length, max_chain)
     s->max_lazy_match = (uInt)max_lazy;
     s->nice_match = nice_length;
     s->max_chain_length = (uInt)max_chain;
+    s->chain_limit = (uInt)max_chain;
+    s->chain_calls = s->chain_work = s->chain_gain = 0;
+    return Z_OK;
+}
+
+/* ========================================================================= */
+int ZEXPORT deflateRate(strm, rate)
+    z_streamp strm;
+    int rate;
+{
+    deflate_state *s;
+
+    if (deflateStateCheck(strm) || rate < 0) return Z_STREAM_ERROR;
+    s = strm->state;
+    s->rate = rate;
+    s->rate_rung = rate_rung(s->level, s->strategy);
+    s->rate_usec = 0;
+    s->rate_in = strm->total_in;
+    s->rate_out = strm->total_out;
     return Z_OK;
 }
 
@@ -706,6 +1015,20 @@ int ZEXPORT deflateTune(strm, good_length, max_lazy, nice_length, max_chain)
  * per 8-bit byte, plus 10 bits for every block. The smallest block size for
  * which this can occur is 255 (memLevel == 2).
  *
+ * Two cases have exact bounds for any windowBits and memLevel. Level 0 only
+ * emits stored blocks, which are at least the smaller of the window size and
+ * the pending buffer size long, except for the last. Z_HUFFMAN_ONLY can always
+ * fall back to a stored block when the symbols buffer is no larger than the
+ * window, and then costs at most 42 bits per block on top of the data: ten
+ * bits of block type and padding plus the lengths, or a Huffman coded block
+ * that is not longer than that. Its blocks end when the symbols buffer is
+ * full, or early after SPLIT_MIN_LENGTH bytes when _tr_split_block() sees the
+ * data change. Z_RLE has the same block ends, and uses the Z_HUFFMAN_ONLY
+ * bound with the default windowBits and memLevel, where blocks that would
+ * need to be stored do not slide out of the window. Neither strategy detects
+ * incompressible input, so their early block ends can come out as stored
+ * blocks, which the 0.03% above does not allow for.
+ *
  * Shifts are used to approximate divisions, for speed.
  */
 uLong ZEXPORT deflateBound(strm, sourceLen)
@@ -713,7 +1036,7 @@ uLong ZEXPORT deflateBound(strm, sourceLen)
     uLong sourceLen;
 {
     deflate_state *s;
-    uLong fixedlen, storelen, wraplen;
+    uLong fixedlen, storelen, wraplen, blocks;
 
     /* upper bound for fixed blocks with 9-bit literals and length 255
        (memLevel == 2, which is the lowest that may not use stored blocks) --
@@ -765,9 +1088,31 @@ uLong ZEXPORT deflateBound(strm, sourceLen)
         wraplen = 6;
     }
 
-    /* if not default parameters, return one of the conservative bounds */
-    if (s->w_bits != 15 || s->hash_bits != 8 + 7)
-        return (s->w_bits <= s->hash_bits ? fixedlen : storelen) + wraplen;
+    /* add a full flush and the start of a new stream at each reset point */
+    if (s->rsyncable)
+        wraplen += (sourceLen / RSYNC_MIN + 1) * 12;
+
+    /* level 0: five bytes of header for each stored block */
+    if (s->level == 0) {
+        blocks = sourceLen / MIN(s->pending_buf_size - 5, s->w_size) + 1;
+        return sourceLen + blocks * 5 + wraplen;
+    }
+
+    /* Z_HUFFMAN_ONLY and Z_RLE: at most 42 bits for each block */
+    if (s->strategy == Z_HUFFMAN_ONLY ?
+            s->lit_bufsize <= s->w_size - MIN_LOOKAHEAD :
+            s->strategy == Z_RLE && s->w_bits == 15 &&
+            s->lit_bufsize == 1 << (8 + 6)) {
+        blocks = sourceLen / MIN(s->sym_end, SPLIT_MIN_LENGTH) + 1;
+        return sourceLen + ((blocks * 42 + 7) >> 3) + wraplen;
+    }
+
+    /* if not default parameters, return one of the conservative bounds --
+       memLevel is told by lit_bufsize, since hash_bits is fixed for the CRC
+       hash */
+    if (s->w_bits != 15 || s->lit_bufsize != 1 << (8 + 6))
+        return (s->w_size <= s->lit_bufsize << 1 ? fixedlen : storelen) +
+               wraplen;
 
     /* default settings: return tight bound for that case -- ~0.03% overhead
        plus a small constant */
@@ -775,6 +1120,74 @@ uLong ZEXPORT deflateBound(strm, sourceLen)
            (sourceLen >> 25) + 13 - 6 + wraplen;
 }
 
+/* =========================================================================
+ * Compress source into dest as a complete stream, starting from a reset of
+ * strm, in pieces that fit avail_in and avail_out as compress2() does. Set
+ * *destLen to the compressed length, and return Z_OK if it fits.
+ */
+local int deflate_item(strm, dest, destLen, source, sourceLen)
+    z_streamp strm;
+    Bytef *dest;
+    uLongf *destLen;
+    const Bytef *source;
+    uLong sourceLen;
+{
+    const uInt max = (uInt)-1;
+    uLong left;
+    int err;
+
+    left = *destLen;
+    *destLen = 0;
+    err = deflateReset(strm);
+    if (err != Z_OK)
+        return err;
+    strm->next_out = dest;
+    strm->avail_out = 0;
+    strm->next_in = (z_const Bytef *)source;
+    strm->avail_in = 0;
+    do {
+        if (strm->avail_out == 0) {
+            strm->avail_out = left > (uLong)max ? max : (uInt)left;
+            left -= strm->avail_out;
+        }
+        if (strm->avail_in == 0) {
+            strm->avail_in = sourceLen > (uLong)max ? max : (uInt)sourceLen;
+            sourceLen -= strm->avail_in;
+        }
+        err = deflate(strm, sourceLen ? Z_NO_FLUSH : Z_FINISH);
+    } while (err == Z_OK);
+    *destLen = strm->total_out;
+    return err == Z_STREAM_END ? Z_OK : err;
+}
+
+/* ========================================================================= */
+int ZEXPORT deflateBatch(strm, count, dest, destLen, source, sourceLen, err)
+    z_streamp strm;
+    unsigned count;
+    Bytef * const *dest;
+    uLongf *destLen;
+    const Bytef * const *source;
+    const uLong *sourceLen;
+    int *err;
+{
+    unsigned i;
+    int ret, e;
+
+    if (deflateStateCheck(strm) || (count != 0 &&
+        (dest == Z_NULL || destLen == Z_NULL || source == Z_NULL ||
+         sourceLen == Z_NULL)))
+        return Z_STREAM_ERROR;
+    ret = Z_OK;
+    for (i = 0; i < count; i++) {
+        e = deflate_item(strm, dest[i], &destLen[i], source[i], sourceLen[i]);
+        if (err != Z_NULL)
+            err[i] = e;
+        if (ret == Z_OK)
+            ret = e;
+    }
+    return ret;
+}
+
 /* =========================================================================
  * Put a short in the pending buffer. The 16-bit value is put in MSB order.
  * IN assertion: the stream state is correct and there is enough room in
@@ -816,6 +1229,145 @@ local void flush_pending(strm)
     }
 }
 
+/* =========================================================================
+ * Hash the input at buf for Z_RSYNCABLE, stopping after a reset point. A
+ * reset point follows a byte where the top RSYNC_BITS bits of the rolling
+ * hash are zero, if it is at least RSYNC_MIN bytes after the previous one.
+ * Each byte is shifted out of the hash after 32 more, so reset points depend
+ * only on the input just before them. Return the number of bytes hashed, and
+ * set s->rsync_hit if the last one ends at a reset point.
+ */
+local uInt rsync_scan(s, buf, len)
+    deflate_state *s;
+    const Bytef *buf;
+    uInt len;
+{
+    uInt h = s->rsync_hash;
+    uInt run = s->rsync_run;
+    uInt n = 0;
+
+    while (n < len) {
+        h = (h << 1) + (buf[n++] + 1) * 2654435761U;
+        if (++run >= RSYNC_MIN && h >> (32 - RSYNC_BITS) == 0) {
+            s->rsync_hit = 1;
+            run = 0;
+            break;
+        }
+    }
+    s->rsync_hash = h;
+    s->rsync_run = run;
+    return n;
+}
+
+/* =========================================================================
+ * Return the rung of the deflateRate() level ladder for level and strategy.
+ */
+local int rate_rung(level, strategy)
+    int level;
+    int strategy;
+{
+    return level == 0 ? 0 :
+           strategy == Z_HUFFMAN_ONLY ? 1 :
+           strategy == Z_RLE ? 2 : level + 2;
+}
+
+/* =========================================================================
+ * Return the time in microseconds for deflateRate(), modulo the range of ulg.
+ * Where the system has a clock for the processor time of the calling thread,
+ * that is used, so that a stream is not charged for the work of other
+ * threads. Windows has no such clock with a fine enough resolution, so there
+ * the elapsed time is used, which other threads only add to when they take
+ * the processor away from this one.
+ */
+local ulg rate_time()
+{
+#if defined(_MSC_VER)
+    LARGE_INTEGER count, freq;
+
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&freq);
+    return (ulg)(count.QuadPart / freq.QuadPart * 1000000 +
+                 count.QuadPart % freq.QuadPart * 1000000 / freq.QuadPart);
+#elif defined(CLOCK_THREAD_CPUTIME_ID) || defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+
+#  ifdef CLOCK_THREAD_CPUTIME_ID
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+#  else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#  endif
+    return (ulg)ts.tv_sec * 1000000 + (ulg)(ts.tv_nsec / 1000);
+#else
+    clock_t ticks = clock();
+
+    return CLOCKS_PER_SEC >= 1000000 ?
+           (ulg)(ticks / (CLOCKS_PER_SEC / 1000000)) :
+           (ulg)ticks * (1000000 / CLOCKS_PER_SEC);
+#endif
+}
+
+/* =========================================================================
+ * Account usec microseconds of compression for deflateRate(). After RATE_MS
+ * milliseconds of it, compare the rate reached with the target and set the
+ * rung to move to at the end of deflate(): one down if it was too slow, or
+ * one up if it was more than a quarter too fast and, from level 1 on, the
+ * input compressed.
+ */
+local void rate_measure(strm, usec)
+    z_streamp strm;
+    ulg usec;
+{
+    deflate_state *s = strm->state;
+    ulg ms, in, out, rate;
+    int rung;
+
+    s->rate_usec += usec;
+    ms = s->rate_usec / 1000;
+    if (ms < RATE_MS)
+        return;
+    in = strm->total_in - s->rate_in;
+    out = strm->total_out - s->rate_out;
+    rate = in / ms;                     /* in kB/s */
+    rung = rate_rung(s->level, s->strategy);
+    if (rate < (ulg)s->rate * 1000) {
+        if (rung > 0)
+            rung--;
+    } else if (rate - (ulg)s->rate * 1000 > (ulg)s->rate * 250 &&
+               (rung < 3 || out < in - (in >> 5)) && rung < RATE_TOP)
+        rung++;
+    s->rate_rung = rung;
+    s->rate_usec = 0;
+    s->rate_in = strm->total_in;
+    s->rate_out = strm->total_out;
+}
+
+/* =========================================================================
+ * Move to the level and strategy of the rung set by rate_measure(), keeping
+ * Z_RSYNCABLE. deflateParams() ends the current block if the deflate function
+ * changes, and leaves the parameters as they were if the output buffer cannot
+ * take all of it, in which case this is retried after the next deflate().
+ */
+local void rate_params(strm)
+    z_streamp strm;
+{
+    deflate_state *s = strm->state;
+    int rung = s->rate_rung;
+
+    if (rung == rate_rung(s->level, s->strategy))
+        return;
+    deflateParams(strm, rung == 0 ? 0 : rung < 3 ? 1 : rung - 2,
+                  (rung == 1 ? Z_HUFFMAN_ONLY : rung == 2 ? Z_RLE :
+                   s->rate_strategy) | (s->rsyncable ? Z_RSYNCABLE : 0));
+    if (s->last_flush == Z_BLOCK)
+        s->last_flush = Z_NO_FLUSH;     /* the application did not flush */
+    if (rung == rate_rung(s->level, s->strategy)) {
+        /* measure the new rung on its own */
+        s->rate_usec = 0;
+        s->rate_in = strm->total_in;
+        s->rate_out = strm->total_out;
+    }
+}
+
 /* ===========================================================================
  * Update the header CRC with the bytes s->pending_buf[beg..s->pending - 1].
  */
@@ -1059,16 +1611,48 @@ int ZEXPORT deflate(strm, flush)
     }
 #endif
 
-    /* Start a new block or continue the current one.
+    /* Start a new block or continue the current one. For Z_RSYNCABLE, the
+     * input is compressed up to each reset point in turn with a full flush.
      */
-    if (strm->avail_in != 0 || s->lookahead != 0 ||
-        (flush != Z_NO_FLUSH && s->status != FINISH_STATE)) {
+    for (;;) {
+        int bflush = flush;     /* flush for the input up to a reset point */
+        uInt hold = 0;          /* input held back after a reset point */
+        uInt used;              /* input made available to this block */
+        int reset = 0;          /* true if a reset point was reached */
+        ulg start = 0;          /* rate_time() before compressing */
         block_state bstate;
 
-        bstate = s->level == 0 ? deflate_stored(s, flush) :
-                 s->strategy == Z_HUFFMAN_ONLY ? deflate_huff(s, flush) :
-                 s->strategy == Z_RLE ? deflate_rle(s, flush) :
-                 (*(configuration_table[s->level].func))(s, flush);
+        if (s->rsyncable && s->status != FINISH_STATE) {
+            if (s->rsync_seen > strm->avail_in)
+                s->rsync_seen = strm->avail_in;
+            if (!s->rsync_hit)
+                s->rsync_seen += rsync_scan(s, strm->next_in + s->rsync_seen,
+                                            strm->avail_in - s->rsync_seen);
+            if (s->rsync_hit) {
+                hold = strm->avail_in - s->rsync_seen;
+                strm->avail_in = s->rsync_seen;
+                if (hold || flush != Z_FINISH)
+                    bflush = Z_FULL_FLUSH;
+            }
+        }
+        if (strm->avail_in == 0 && s->lookahead == 0 &&
+            (bflush == Z_NO_FLUSH || s->status == FINISH_STATE)) {
+            strm->avail_in += hold;
+            break;
+        }
+        used = strm->avail_in;
+
+        zero_copy_start(s, bflush);
+        if (s->rate)
+            start = rate_time();
+        bstate = (*COMPRESS_FUNC(s->level, s->strategy))(s, bflush);
+        if (s->rate)
+            rate_measure(strm, rate_time() - start);
+        zero_copy_end(s);
+
+        if (s->rsyncable)
+            s->rsync_seen -= used - strm->avail_in;
+        strm->avail_in += hold;
 
         if (bstate == finish_started || bstate == finish_done) {
             s->status = FINISH_STATE;
@@ -1076,6 +1660,8 @@ int ZEXPORT deflate(strm, flush)
         if (bstate == need_more || bstate == finish_started) {
             if (strm->avail_out == 0) {
                 s->last_flush = -1; /* avoid BUF_ERROR next call, see above */
+            } else if (s->rate && flush == Z_NO_FLUSH) {
+                rate_params(strm);
             }
             return Z_OK;
             /* If flush != Z_NO_FLUSH && avail_out == 0, the next call
@@ -1087,14 +1673,14 @@ int ZEXPORT deflate(strm, flush)
              */
         }
         if (bstate == block_done) {
-            if (flush == Z_PARTIAL_FLUSH) {
+            if (bflush == Z_PARTIAL_FLUSH) {
                 _tr_align(s);
-            } else if (flush != Z_BLOCK) { /* FULL_FLUSH or SYNC_FLUSH */
+            } else if (bflush != Z_BLOCK) { /* FULL_FLUSH or SYNC_FLUSH */
                 _tr_stored_block(s, (char*)0, 0L, 0);
                 /* For a full flush, this empty block will be recognized
                  * as a special marker by inflate_sync().
                  */
-                if (flush == Z_FULL_FLUSH) {
+                if (bflush == Z_FULL_FLUSH) {
                     CLEAR_HASH(s);             /* forget history */
                     if (s->lookahead == 0) {
                         s->strstart = 0;
@@ -1103,15 +1689,27 @@ int ZEXPORT deflate(strm, flush)
                     }
                 }
             }
+            if (s->rsync_hit && s->rsync_seen == 0) {
+                /* the reset point is reached: start afresh after it */
+                s->rsync_hit = 0;
+                s->incompressible = 0;
+                reset = 1;
+            }
             flush_pending(strm);
             if (strm->avail_out == 0) {
               s->last_flush = -1; /* avoid BUF_ERROR at next call, see above */
               return Z_OK;
             }
         }
+        if (!reset || hold == 0)
+            break;
     }
 
-    if (flush != Z_FINISH) return Z_OK;
+    if (flush != Z_FINISH) {
+        if (s->rate && flush == Z_NO_FLUSH)
+            rate_params(strm);
+        return Z_OK;
+    }
     if (s->wrap <= 0) return Z_STREAM_END;
 
     /* Write the trailer */
@@ -1153,9 +1751,10 @@ int ZEXPORT deflateEnd(strm)
 
     /* Deallocate in reverse order of allocations: */
     TRY_FREE(strm, strm->state->pending_buf);
+    TRY_FREE(strm, strm->state->head3);
     TRY_FREE(strm, strm->state->head);
     TRY_FREE(strm, strm->state->prev);
-    TRY_FREE(strm, strm->state->window);
+    TRY_FREE(strm, strm->state->window_buf);
 
     ZFREE(strm, strm->state);
     strm->state = Z_NULL;
@@ -1194,14 +1793,16 @@ int ZEXPORT deflateCopy(dest, source)
     zmemcpy((voidpf)ds, (voidpf)ss, sizeof(deflate_state));
     ds->strm = dest;
 
-    ds->window = (Bytef *) ZALLOC(dest, ds->w_size, 2*sizeof(Byte));
+    ds->window = (Bytef *) ZALLOC(dest, ds->w_size + WIN_PAD/2, 2*sizeof(Byte));
+    ds->window_buf = ds->window;
     ds->prev   = (Posf *)  ZALLOC(dest, ds->w_size, sizeof(Pos));
     ds->head   = (Posf *)  ZALLOC(dest, ds->hash_size, sizeof(Pos));
-    overlay = (ushf *) ZALLOC(dest, ds->lit_bufsize, sizeof(ush)+2);
+    ds->head3  = (Posf *)  ZALLOC(dest, HASH3_SIZE, sizeof(Pos));
+    overlay = (ushf *) ZALLOC(dest, ds->lit_bufsize, LIT_BUFS);
     ds->pending_buf = (uchf *) overlay;
 
     if (ds->window == Z_NULL || ds->prev == Z_NULL || ds->head == Z_NULL ||
-        ds->pending_buf == Z_NULL) {
+        ds->head3 == Z_NULL || ds->pending_buf == Z_NULL) {
         deflateEnd (dest);
         return Z_MEM_ERROR;
     }
@@ -1209,10 +1810,11 @@ int ZEXPORT deflateCopy(dest, source)
     zmemcpy(ds->window, ss->window, ds->w_size * 2 * sizeof(Byte));
     zmemcpy((voidpf)ds->prev, (voidpf)ss->prev, ds->w_size * sizeof(Pos));
     zmemcpy((voidpf)ds->head, (voidpf)ss->head, ds->hash_size * sizeof(Pos));
-    zmemcpy(ds->pending_buf, ss->pending_buf, (uInt)ds->pending_buf_size);
+    zmemcpy((voidpf)ds->head3, (voidpf)ss->head3, HASH3_SIZE * sizeof(Pos));
+    zmemcpy(ds->pending_buf, ss->pending_buf, ds->lit_bufsize * LIT_BUFS);
 
     ds->pending_out = ds->pending_buf + (ss->pending_out - ss->pending_buf);
-    ds->sym_buf = ds->pending_buf + ds->lit_bufsize;
+    ds->sym_buf = (uint32_t *)(ds->pending_buf + ds->lit_bufsize);
 
     ds->l_desc.dyn_tree = ds->dyn_ltree;
     ds->d_desc.dyn_tree = ds->dyn_dtree;
@@ -1227,7 +1829,8 @@ int ZEXPORT deflateCopy(dest, source)
  * and total number of bytes read.  All deflate() input goes through
  * this function so some applications may wish to modify it to avoid
  * allocating a large strm->next_in buffer and copying from it.
- * (See also flush_pending()).
+ * (See also flush_pending()). If buf is strm->next_in, the window is the
+ * input itself and the bytes are only checksummed.
  */
 ZLIB_INTERNAL unsigned read_buf(strm, buf, size)
     z_streamp strm;
@@ -1243,12 +1846,16 @@ ZLIB_INTERNAL unsigned read_buf(strm, buf, size)
 
 #ifdef GZIP
     if (strm->state->wrap == 2) {
-        copy_with_crc(strm, buf, len);
+        if (buf == strm->next_in)
+            crc_in_place(strm, buf, len);
+        else
+            copy_with_crc(strm, buf, len);
     }
     else
 #endif
     {
-        zmemcpy(buf, strm->next_in, len);
+        if (buf != strm->next_in)
+            zmemcpy(buf, strm->next_in, len);
         if (strm->state->wrap == 1)
             strm->adler = adler32(strm->adler, buf, len);
     }
@@ -1258,6 +1865,111 @@ ZLIB_INTERNAL unsigned read_buf(strm, buf, size)
     return len;
 }
 
+/* ===========================================================================
+ * Compress the input in place when deflate() is given all of it at once: the
+ * window then points into strm->next_in, so that fill_window() only has to
+ * checksum the input instead of copying it, and slide_window() only has to
+ * move the window pointer. This needs a stream without history, a level
+ * that does not use deflate_stored(), which writes to the window, and at
+ * least a whole window of input plus WIN_PAD bytes.
+ */
+local void zero_copy_start(s, flush)
+    deflate_state *s;
+    int flush;
+{
+    if (flush == Z_FINISH && s->level != 0 &&
+        s->strstart == 0 && s->lookahead == 0 &&
+        s->strm->avail_in >= s->window_size + WIN_PAD) {
+        s->window = (Bytef *)s->strm->next_in;
+        s->lazy_clear = 0;
+    }
+}
+
+/* ===========================================================================
+ * Return to the allocated window before deflate() returns, since the
+ * application may reuse its input buffer after that.
+ */
+local void zero_copy_end(s)
+    deflate_state *s;
+{
+    uInt have = s->strstart + s->lookahead;
+
+    if (s->window == s->window_buf)
+        return;
+    zmemcpy(s->window_buf, s->window, have);
+    s->window = s->window_buf;
+    if (s->high_water < have)
+        s->high_water = have;
+}
+
+/* ===========================================================================
+ * Clear the hash tables for a new stream. If head[] only holds the strings
+ * of the last input and that input was short, only the buckets of those
+ * strings are cleared, so that the cost of a reset follows the size of the
+ * last input instead of hash_size.
+ */
+local void reset_hash(s)
+    deflate_state *s;
+{
+    uInt str, end, h = 0;
+
+    end = s->strstart + s->lookahead;
+    if (!s->lazy_clear || end > (s->hash_size >> LAZY_CLEAR_SHIFT)) {
+        CLEAR_HASH(s);
+        s->lazy_clear = 1;
+        return;
+    }
+    Assert(s->window == s->window_buf, "window not reset");
+#if defined(_M_IX86) || defined(_M_AMD64)
+    if (!LONG_HASH)
+#endif
+    {
+        h = s->window[0];
+        UPDATE_HASH_C(s, h, s->window[1]);
+#if MIN_MATCH != 3
+        Call UPDATE_HASH() MIN_MATCH-3 more times
+#endif
+    }
+    for (str = 0; str + MIN_MATCH <= end; str++) {
+        UPDATE_HASH(s, h, s->window[str + MIN_MATCH-1]);
+        s->head[h] = NIL;
+    }
+    zmemzero((Bytef *)s->head3, HASH3_SIZE*sizeof(*s->head3));
+#ifdef ZLIB_DEBUG
+    for (h = 0; h < s->hash_size; h++)
+        Assert(s->head[h] == NIL, "string left in head[]");
+#endif
+}
+
+/* ===========================================================================
+ * Send the string at strstart-1 that deflate_slow() keeps while it looks for
+ * a longer match at strstart as a literal, as deflate_slow() does at the end
+ * of its input, so that deflateParams() can switch to another function
+ * without ending the block. Return false if the literal would fill the
+ * symbol buffer or reach a block split check, in which case the block has to
+ * be flushed by deflate() instead.
+ */
+local int settle_lazy(s)
+    deflate_state *s;
+{
+    int bflush;
+
+    if (!s->match_available)
+        return 1;
+    if (s->incompressible) {
+        /* the literal is stored with the block */
+        s->match_available = 0;
+        return 1;
+    }
+    if (s->sym_next + 1 == s->sym_end ||
+        ((s->sym_next + 1) & (SPLIT_CHECK - 1)) == 0)
+        return 0;
+    Tracevv((stderr,"%c", s->window[s->strstart - 1]));
+    _tr_tally_lit(s, s->window[s->strstart - 1], bflush);
+    s->match_available = 0;
+    return !bflush;
+}
+
 /* ===========================================================================
  * Initialize the "longest match" routines for a new zlib stream
  */
@@ -1266,7 +1978,7 @@ local void lm_init(s)
 {
     s->window_size = (ulg)2L*s->w_size;
 
-    CLEAR_HASH(s);
+    reset_hash(s);
 
     /* Set the default configuration parameters:
      */
@@ -1274,6 +1986,8 @@ local void lm_init(s)
     s->good_match       = configuration_table[s->level].good_length;
     s->nice_match       = configuration_table[s->level].nice_length;
     s->max_chain_length = configuration_table[s->level].max_chain;
+    s->chain_limit      = s->max_chain_length;
+    s->chain_calls = s->chain_work = s->chain_gain = 0;
 
     s->strstart = 0;
     s->block_start = 0L;
@@ -1281,7 +1995,15 @@ local void lm_init(s)
     s->insert = 0;
     s->match_length = s->prev_length = MIN_MATCH-1;
     s->match_available = 0;
+    s->incompressible = 0;
     s->ins_h = 0;
+    /* have fill_window() zero the bytes after the new input again, which
+     * longest_match() can compare, so that the output does not depend on
+     * the input before the reset */
+    s->high_water = 0;
+#ifdef POS32
+    s->pos_base = 0;
+#endif
 }
 
 #ifndef FASTEST
@@ -1307,13 +2029,14 @@ local uInt longest_match(s, cur_match)
     register uInt len;                           /* length of current match */
     uInt best_len = s->prev_length;              /* best match length so far */
     uInt nice_match = s->nice_match;             /* stop if match long enough */
-    IPos limit = s->strstart > (IPos)MAX_DIST(s) ?
-        s->strstart - (IPos)MAX_DIST(s) : NIL;
+    IPos limit = (s->strstart > (IPos)MAX_DIST(s) ?
+        s->strstart - (IPos)MAX_DIST(s) : NIL) + POS_BASE(s);
     /* Stop when cur_match becomes <= limit. To simplify the code,
      * we prevent matches with the string of window index 0.
      */
     Posf *prev = s->prev;
     uInt wmask = s->w_mask;
+    Bytef *win = s->window - POS_BASE(s);        /* window for positions */
 
 #ifdef UNALIGNED_OK
     /* Compare two bytes at a time. Note: this is not always beneficial.
@@ -1346,7 +2069,7 @@ local uInt longest_match(s, cur_match)
            "need lookahead");
 
     do {
-        Assert(cur_match < s->strstart, "no future");
+        Assert(cur_match - POS_BASE(s) < s->strstart, "no future");
 
         /* Skip to next match if the match length cannot increase
          * or if the match length is less than 2.  Note that the checks below
@@ -1357,7 +2080,6 @@ local uInt longest_match(s, cur_match)
          * the output of deflate is not affected by the uninitialized values.
          */
 #if (defined(UNALIGNED_OK) && MAX_MATCH == 258)
-        Bytef *win = s->window;
         int cont = 1;
         do {
             match = win + cur_match;
@@ -1404,7 +2126,7 @@ local uInt longest_match(s, cur_match)
         scan = strend - MAX_MATCH;
 
 #else /* UNALIGNED_OK */
-        match = s->window + cur_match;
+        match = win + cur_match;
 
         if (match[best_len]   != scan_end  ||
             match[best_len - 1] != scan_end1 ||
@@ -1439,7 +2161,7 @@ local uInt longest_match(s, cur_match)
 #endif /* UNALIGNED_OK */
 
         if (len > best_len) {
-            s->match_start = cur_match;
+            s->match_start = cur_match - POS_BASE(s);
             best_len = len;
             if (len >= nice_match) break;
 #ifdef UNALIGNED_OK
@@ -1478,9 +2200,9 @@ local uInt longest_match(s, cur_match)
     Assert((ulg)s->strstart <= s->window_size - MIN_LOOKAHEAD,
            "need lookahead");
 
-    Assert(cur_match < s->strstart, "no future");
+    Assert(cur_match - POS_BASE(s) < s->strstart, "no future");
 
-    match = s->window + cur_match;
+    match = s->window + (cur_match - POS_BASE(s));
 
     /* Return failure if the match length is less than 2:
      */
@@ -1511,12 +2233,61 @@ local uInt longest_match(s, cur_match)
 
     if (len < MIN_MATCH) return MIN_MATCH - 1;
 
-    s->match_start = cur_match;
+    s->match_start = cur_match - POS_BASE(s);
     return (uInt)len <= s->lookahead ? (uInt)len : s->lookahead;
 }
 
 #endif /* FASTEST */
 
+/* ===========================================================================
+ * Look up the previous search position with the same first MIN_MATCH bytes
+ * as strstart in head3[], and enter strstart in its place. Return the length
+ * of that match if it is longer than best_len, and set match_start to it;
+ * otherwise return best_len unchanged. This finds the 3-byte matches that
+ * the 4-byte CRC hash of head[] misses. Only one candidate is checked and
+ * 3-byte matches farther than TOO_FAR are ignored.
+ * IN assertion: lookahead >= MIN_MATCH
+ */
+local uInt short_match(s, best_len)
+    deflate_state *s;
+    uInt best_len;
+{
+    Bytef *scan = s->window + s->strstart;
+    Bytef *match;
+    uInt h, len;
+    IPos cur_match;
+
+    Assert(s->lookahead >= MIN_MATCH, "need lookahead");
+
+    h = ((uInt)scan[0] | ((uInt)scan[1] << 8) | ((uInt)scan[2] << 16)) *
+        2654435761U >> (32 - HASH3_BITS);
+    cur_match = s->head3[h];
+    s->head3[h] = (Pos)(s->strstart + POS_BASE(s));
+
+    if (best_len > MIN_MATCH || cur_match <= POS_BASE(s) ||
+        s->strstart + POS_BASE(s) - cur_match > MAX_DIST(s))
+        return best_len;
+    match = s->window + (cur_match - POS_BASE(s));
+    if (match[0] != scan[0] || match[1] != scan[1] || match[2] != scan[2])
+        return best_len;
+
+#if defined(_M_IX86) || defined(_M_AMD64)
+    len = compare256_sse2(scan + 2, match + 2) + 2;
+#elif defined(UNALIGNED64_OK)
+    len = compare256_unaligned_64(scan + 2, match + 2) + 2;
+#else
+    len = compare256_unaligned_32(scan + 2, match + 2) + 2;
+#endif
+    Assert(scan + len <= s->window + (uInt)(s->window_size - 1), "wild scan");
+    if (len > s->lookahead)
+        len = s->lookahead;
+    if (len <= best_len ||
+        (len == MIN_MATCH && s->strstart + POS_BASE(s) - cur_match > TOO_FAR))
+        return best_len;
+    s->match_start = cur_match - POS_BASE(s);
+    return len;
+}
+
 #ifdef ZLIB_DEBUG
 
 #define EQUAL 0
@@ -1549,6 +2320,27 @@ local void check_match(s, start, match, length)
 #  define check_match(s, start, match, length)
 #endif /* ZLIB_DEBUG */
 
+/* ===========================================================================
+ * Move the size bytes at window + w_size down to the start of the window.
+ * When the window is the input itself, and the input holds a whole window
+ * plus WIN_PAD bytes after the new window start, only move the window
+ * pointer. Otherwise copy the bytes to the allocated window, which is used
+ * from then on.
+ */
+void ZLIB_INTERNAL slide_window(s, size)
+    deflate_state *s;
+    unsigned size;
+{
+    if (s->window != s->window_buf &&
+        (ulg)s->strstart + s->lookahead + s->strm->avail_in >=
+        s->w_size + s->window_size + WIN_PAD) {
+        s->window += s->w_size;
+        return;
+    }
+    zmemcpy(s->window_buf, s->window + s->w_size, size);
+    s->window = s->window_buf;
+}
+
 /* ===========================================================================
  * Fill the window when the lookahead becomes insufficient.
  * Updates strstart and lookahead.
@@ -1590,13 +2382,14 @@ local void fill_window_c(s)
          */
         if (s->strstart >= wsize + MAX_DIST(s)) {
 
-            zmemcpy(s->window, s->window + wsize, (unsigned)wsize - more);
+            slide_window(s, (unsigned)wsize - more);
             s->match_start -= wsize;
             s->strstart    -= wsize; /* we now have strstart >= MAX_DIST */
             s->block_start -= (long) wsize;
             if (s->insert > s->strstart)
                 s->insert = s->strstart;
             slide_hash(s);
+            s->lazy_clear = 0;
             more += wsize;
         }
         if (s->strm->avail_in == 0) break;
@@ -1613,6 +2406,9 @@ local void fill_window_c(s)
          * If there was sliding, more >= WSIZE. So in all cases, more >= 2.
          */
         Assert(more >= 2, "more < 2");
+        Assert(s->window == s->window_buf ||
+               s->window + s->strstart + s->lookahead == s->strm->next_in,
+               "window not at input");
 
         n = read_buf(s->strm, s->window + s->strstart + s->lookahead, more);
         s->lookahead += n;
@@ -1622,7 +2418,7 @@ local void fill_window_c(s)
             uInt str = s->strstart - s->insert;
 
 #if defined(_M_IX86) || defined(_M_AMD64)
-	    if (!x86_cpu_has_sse42)
+	    if (!LONG_HASH)
 #endif
             {
                 s->ins_h = s->window[str];
@@ -1632,12 +2428,15 @@ local void fill_window_c(s)
 #endif
             }
 
+            /* these strings may be hashed with bytes past the input */
+            if (s->insert)
+                s->lazy_clear = 0;
             while (s->insert) {
                 UPDATE_HASH(s, s->ins_h, s->window[str + MIN_MATCH-1]);
 #ifndef FASTEST
                 s->prev[str & s->w_mask] = s->head[s->ins_h];
 #endif
-                s->head[s->ins_h] = (Pos)str;
+                s->head[s->ins_h] = (Pos)(str + POS_BASE(s));
                 str++;
                 s->insert--;
                 if (s->lookahead + s->insert < MIN_MATCH)
@@ -1656,8 +2455,9 @@ local void fill_window_c(s)
      * the longest match routines.  Update the high water mark for the next
      * time through here.  WIN_INIT is set to MAX_MATCH since the longest match
      * routines allow scanning to strstart + MAX_MATCH, ignoring lookahead.
+     * A window in the input itself is never written.
      */
-    if (s->high_water < s->window_size) {
+    if (s->high_water < s->window_size && s->window == s->window_buf) {
         ulg curr = s->strstart + (ulg)(s->lookahead);
         ulg init;
 
@@ -1913,6 +2713,99 @@ local block_state deflate_stored(s, flush)
     return last ? finish_started : need_more;
 }
 
+/* ===========================================================================
+ * Store incompressible input without LZ parsing, once _tr_split_block() has
+ * set s->incompressible and dropped the symbols of the current block. The
+ * input from block_start on is copied in stored blocks of STORED_RUN bytes,
+ * which skips the match search and the hash insertions of that data, for as
+ * long as the byte histogram of each new piece of the lookahead stays flat.
+ * Then s->incompressible is cleared, the bytes before strstart are stored,
+ * the last MAX_MATCH stored strings are inserted so that the next block can
+ * match them, and the LZ parsing resumes at strstart. Return need_more if
+ * deflate() must return first, either for more input or for more output
+ * space, otherwise block_done.
+ */
+local block_state deflate_stored_run(s, flush)
+    deflate_state *s;
+    int flush;
+{
+    uInt start = s->strstart;   /* first string not inserted */
+    uInt hist[256];
+    uInt have, want, i;
+    ulg sumsq;
+    int last;                   /* true if the input is used up */
+
+    for (;;) {
+        if (s->lookahead < MIN_LOOKAHEAD)
+            fill_window(s);
+        Assert(s->block_start >= 0L, "block gone");
+
+        /* Wait for enough input to complete the stored block, unless
+         * flushing. If input is left over the window is full, and the
+         * lookahead is taken as it is to make room for sliding the window.
+         */
+        want = STORED_RUN - (uInt)((long)s->strstart - s->block_start);
+        have = s->lookahead < want ? s->lookahead : want;
+        if (have < want && flush == Z_NO_FLUSH && s->strm->avail_in == 0)
+            return need_more;
+
+        if (have) {
+            zmemzero(hist, sizeof(hist));
+            for (i = 0; i < have; i++)
+                hist[s->window[s->strstart + i]]++;
+            sumsq = 0;
+            for (i = 0; i < 256; i++)
+                sumsq += (ulg)hist[i] * hist[i];
+            if (!FLAT_HISTOGRAM(sumsq, have))
+                break;
+            s->strstart += have;
+            s->lookahead -= have;
+        }
+
+        last = s->lookahead == 0 && s->strm->avail_in == 0;
+        if ((have == want || last) && (long)s->strstart > s->block_start) {
+            _tr_stored_block(s, (charf *)&s->window[(unsigned)s->block_start],
+                             (ulg)((long)s->strstart - s->block_start), 0);
+            s->block_start = s->strstart;
+            flush_pending(s->strm);
+            Tracev((stderr,"[STORED RUN]"));
+            if (s->strm->avail_out == 0)
+                return need_more;
+        }
+        if (last)
+            return flush == Z_NO_FLUSH ? need_more : block_done;
+    }
+
+    s->incompressible = 0;
+    if ((long)s->strstart > s->block_start) {
+        _tr_stored_block(s, (charf *)&s->window[(unsigned)s->block_start],
+                         (ulg)((long)s->strstart - s->block_start), 0);
+        s->block_start = s->strstart;
+        flush_pending(s->strm);
+    }
+    if (s->strstart - start > MAX_MATCH)
+        start = s->strstart - MAX_MATCH;
+    if (start < s->strstart) {
+        s->lazy_clear = 0;
+#if !defined(_M_ARM64)
+#if defined(_M_IX86) || defined(_M_AMD64)
+        if (!LONG_HASH)
+#endif
+        {
+            s->ins_h = s->window[start];
+            UPDATE_HASH_C(s, s->ins_h, s->window[start + 1]);
+#if MIN_MATCH != 3
+            Call UPDATE_HASH() MIN_MATCH-3 more times
+#endif
+        }
+#endif
+        do {
+            insert_string(s, start);
+        } while (++start < s->strstart);
+    }
+    return s->strm->avail_out == 0 ? need_more : block_done;
+}
+
 /* ===========================================================================
  * Compress as much as possible from the input stream, return the current
  * block state.
@@ -1928,6 +2821,9 @@ local block_state deflate_fast(s, flush)
     int bflush;           /* set if current block must be flushed */
 
     for (;;) {
+        if (s->incompressible && deflate_stored_run(s, flush) == need_more)
+            return need_more;
+
         /* Make sure that we always have enough lookahead, except
          * at the end of the input file. We need MAX_MATCH bytes
          * for the next match, plus MIN_MATCH bytes to insert the
@@ -1952,7 +2848,8 @@ local block_state deflate_fast(s, flush)
         /* Find the longest match, discarding those <= prev_length.
          * At this point we have always match_length < MIN_MATCH
          */
-        if (hash_head != NIL && s->strstart - hash_head <= MAX_DIST(s)) {
+        if (hash_head > POS_BASE(s) &&
+            s->strstart + POS_BASE(s) - hash_head <= MAX_DIST(s)) {
             /* To simplify the code, we prevent matches with the string
              * of window index 0 (in particular we have to avoid a match
              * of the string with itself at the start of the input file).
@@ -1991,7 +2888,7 @@ local block_state deflate_fast(s, flush)
 
 #if !defined(_M_ARM64)
 #if defined(_M_IX86) || defined(_M_AMD64)
-                if (!x86_cpu_has_sse42)
+                if (!LONG_HASH)
 #endif
 		        {
                     s->ins_h = s->window[s->strstart];
@@ -2026,6 +2923,31 @@ local block_state deflate_fast(s, flush)
 }
 
 #ifndef FASTEST
+/* ===========================================================================
+ * Adapt the hash chain length searched by deflate_slow() to the last
+ * CHAIN_PERIOD searches. If they walked more than CHAIN_BUDGET steps each past
+ * the first quarter of the chain and those steps rarely found a longer match,
+ * as on inputs with few distinct strings and long chains, the chain is
+ * shortened by an eighth. Otherwise it is lengthened by an eighth, up to
+ * max_chain_length. Searches that end early cost nothing here, so typical
+ * inputs keep the full chain.
+ */
+local void adapt_chain(s)
+    deflate_state *s;
+{
+    if (s->chain_work > (uInt)CHAIN_BUDGET * CHAIN_PERIOD &&
+        s->chain_work > s->chain_gain << 8) {
+        if (s->chain_limit > s->max_chain_length >> CHAIN_FLOOR_SHIFT &&
+            s->chain_limit > 4)
+            s->chain_limit -= s->chain_limit >> 3;
+    } else if (s->chain_limit < s->max_chain_length) {
+        s->chain_limit += (s->chain_limit >> 3) + 1;
+        if (s->chain_limit > s->max_chain_length)
+            s->chain_limit = s->max_chain_length;
+    }
+    s->chain_calls = s->chain_work = s->chain_gain = 0;
+}
+
 /* ===========================================================================
  * Same as above, but achieves better compression. We use a lazy
  * evaluation for matches: a match is finally adopted only if there is
@@ -2040,6 +2962,14 @@ local block_state deflate_slow(s, flush)
 
     /* Process the input block. */
     for (;;) {
+        if (s->incompressible) {
+            /* a pending literal or match is stored with the block */
+            s->match_available = 0;
+            s->match_length = MIN_MATCH-1;
+            if (deflate_stored_run(s, flush) == need_more)
+                return need_more;
+        }
+
         /* Make sure that we always have enough lookahead, except
          * at the end of the input file. We need MAX_MATCH bytes
          * for the next match, plus MIN_MATCH bytes to insert the
@@ -2066,27 +2996,31 @@ local block_state deflate_slow(s, flush)
         s->prev_length = s->match_length, s->prev_match = s->match_start;
         s->match_length = MIN_MATCH-1;
 
-        if (hash_head != NIL && s->prev_length < s->max_lazy_match &&
-            s->strstart - hash_head <= MAX_DIST(s)) {
+        if (hash_head > POS_BASE(s) && s->prev_length < s->max_lazy_match &&
+            s->strstart + POS_BASE(s) - hash_head <= MAX_DIST(s)) {
             /* To simplify the code, we prevent matches with the string
              * of window index 0 (in particular we have to avoid a match
              * of the string with itself at the start of the input file).
              */
             s->match_length = longest_match_slow (s, hash_head);
             /* longest_match() sets match_start */
-
-            if (s->match_length <= 5 && (s->strategy == Z_FILTERED
+            if (++s->chain_calls == CHAIN_PERIOD) adapt_chain(s);
+        }
+        if (LONG_HASH && s->prev_length < s->max_lazy_match &&
+            s->lookahead >= MIN_MATCH)
+            s->match_length = short_match(s, s->match_length);
+        if (s->match_length >= MIN_MATCH && s->match_length <= 5 &&
+            (s->strategy == Z_FILTERED
 #if TOO_FAR <= 32767
-                || (s->match_length == MIN_MATCH &&
-                    s->strstart - s->match_start > TOO_FAR)
+             || (s->match_length == MIN_MATCH &&
+                 s->strstart - s->match_start > TOO_FAR)
 #endif
-                )) {
+            )) {
 
-                /* If prev_match is also MIN_MATCH, match_start is garbage
-                 * but we will ignore the current match anyway.
-                 */
-                s->match_length = MIN_MATCH-1;
-            }
+            /* If prev_match is also MIN_MATCH, match_start is garbage
+             * but we will ignore the current match anyway.
+             */
+            s->match_length = MIN_MATCH-1;
         }
         /* If there was a match at the previous step and the current
          * match is not better, output the previous match:
@@ -2108,13 +3042,14 @@ local block_state deflate_slow(s, flush)
             s->lookahead -= s->prev_length-1;
 
             uInt string_count = s->prev_length - 2;
-            uInt insert_count = min(string_count, max_insert - s->strstart);
+            uInt insert_count = max_insert < s->strstart ? 0 :
+                                min(string_count, max_insert - s->strstart);
             uInt start_pos = s->strstart + 1;
-#if defined(M_ARM64)
+#if defined(_M_ARM64)
             insert_string_acle(s, start_pos, insert_count);
 #else
 #if defined(_M_IX86) || defined(_M_AMD64)
-            if (x86_cpu_has_sse42) {
+            if (LONG_HASH) {
                 for (uInt i = 0; i < insert_count; i++) {
                     insert_string_sse(s, start_pos);
                     start_pos++;
@@ -2164,6 +3099,8 @@ local block_state deflate_slow(s, flush)
         _tr_tally_lit(s, s->window[s->strstart - 1], bflush);
         s->match_available = 0;
     }
+    if (s->incompressible && deflate_stored_run(s, flush) == need_more)
+        return need_more;
     s->insert = s->strstart < MIN_MATCH-1 ? s->strstart : MIN_MATCH-1;
     if (flush == Z_FINISH) {
         FLUSH_BLOCK(s, 1);
@@ -2175,23 +3112,50 @@ local block_state deflate_slow(s, flush)
 }
 #endif /* FASTEST */
 
+/* ===========================================================================
+ * Return the offset of the first byte in buf[0..len-1] that starts a run,
+ * i.e. that is equal to the byte before it and to the two bytes after it, or
+ * len if there is none. buf[-1] through buf[len + 1] must be valid. The SIMD
+ * versions test a whole vector of positions at once.
+ */
+local z_size_t runscan(buf, len)
+    const Bytef *buf;
+    z_size_t len;
+{
+#if defined(_M_IX86) || defined(_M_AMD64)
+    return runscan_sse2(buf, len);
+#elif defined(_M_ARM64)
+    return runscan_neon(buf, len);
+#else
+    z_size_t i;
+
+    for (i = 0; i < len; i++)
+        if (buf[i - 1] == buf[i] && buf[i] == buf[i + 1] &&
+            buf[i + 1] == buf[i + 2])
+            break;
+    return i;
+#endif
+}
+
 /* ===========================================================================
  * For Z_RLE, simply look for runs of bytes, generate matches only of distance
  * one.  Do not maintain a hash table.  (It will be regenerated if this run of
- * deflate switches away from Z_RLE.)
+ * deflate switches away from Z_RLE.) The length of a run is measured with the
+ * same compare256 functions as longest_match(), and the literal bytes up to
+ * the next run are found with runscan() and tallied at once.
  */
 local block_state deflate_rle(s, flush)
     deflate_state *s;
     int flush;
 {
     int bflush;             /* set if current block must be flushed */
-    uInt prev;              /* byte at distance one to match */
-    Bytef *scan, *strend;   /* scan goes up to strend for length of run */
+    uInt n;                 /* number of literals to output */
+    Bytef *scan;            /* start of the run or of the literals */
 
     for (;;) {
         /* Make sure that we always have enough lookahead, except
          * at the end of the input file. We need MAX_MATCH bytes
-         * for the longest run, plus one for the unrolled loop.
+         * for the longest run.
          */
         if (s->lookahead <= MAX_MATCH) {
             fill_window(s);
@@ -2201,28 +3165,31 @@ local block_state deflate_rle(s, flush)
             if (s->lookahead == 0) break; /* flush the current block */
         }
 
-        /* See how many times the previous byte repeats */
+        /* See how many times the previous byte repeats. compare256 may read
+         * past the lookahead, but not past the end of the window.
+         */
         s->match_length = 0;
-        if (s->lookahead >= MIN_MATCH && s->strstart > 0) {
-            scan = s->window + s->strstart - 1;
-            prev = *scan;
-            if (prev == *++scan && prev == *++scan && prev == *++scan) {
-                strend = s->window + s->strstart + MAX_MATCH;
-                do {
-                } while (prev == *++scan && prev == *++scan &&
-                         prev == *++scan && prev == *++scan &&
-                         prev == *++scan && prev == *++scan &&
-                         prev == *++scan && prev == *++scan &&
-                         scan < strend);
-                s->match_length = MAX_MATCH - (uInt)(strend - scan);
-                if (s->match_length > s->lookahead)
-                    s->match_length = s->lookahead;
-            }
-            Assert(scan <= s->window + (uInt)(s->window_size - 1),
-                   "wild scan");
+        scan = s->window + s->strstart;
+        if (s->lookahead >= MIN_MATCH && s->strstart > 0 &&
+            scan[-1] == scan[0] && scan[0] == scan[1] && scan[1] == scan[2]) {
+#if defined(_M_IX86) || defined(_M_AMD64)
+            s->match_length = compare256_sse2(scan + 2, scan + 1) + 2;
+#elif defined(UNALIGNED64_OK)
+            s->match_length = compare256_unaligned_64(scan + 2, scan + 1) + 2;
+#else
+            s->match_length = compare256_unaligned_32(scan + 2, scan + 1) + 2;
+#endif
+            if (s->match_length > s->lookahead)
+                s->match_length = s->lookahead;
+            Assert(scan + s->match_length <=
+                   s->window + (uInt)(s->window_size - 1), "wild scan");
         }
 
-        /* Emit match if have run of MIN_MATCH or longer, else emit literal */
+        /* Emit match if have run of MIN_MATCH or longer, else emit the
+         * literal bytes up to the next run or up to the next check for the
+         * end of the block at once. A run cannot start in the last
+         * MIN_MATCH-1 bytes of the lookahead.
+         */
         if (s->match_length >= MIN_MATCH) {
             check_match(s, s->strstart, s->strstart - 1, s->match_length);
 
@@ -2232,11 +3199,20 @@ local block_state deflate_rle(s, flush)
             s->strstart += s->match_length;
             s->match_length = 0;
         } else {
-            /* No match, output a literal byte */
-            Tracevv((stderr,"%c", s->window[s->strstart]));
-            _tr_tally_lit(s, s->window[s->strstart], bflush);
-            s->lookahead--;
-            s->strstart++;
+            n = SPLIT_CHECK - (s->sym_next & (SPLIT_CHECK - 1));
+            if (n > s->sym_end - s->sym_next)
+                n = s->sym_end - s->sym_next;
+            if (s->lookahead < MIN_MATCH) {
+                if (n > s->lookahead)
+                    n = s->lookahead;
+            } else {
+                if (n > s->lookahead - (MIN_MATCH-1))
+                    n = s->lookahead - (MIN_MATCH-1);
+                n = 1 + (uInt)runscan(scan + 1, n - 1);
+            }
+            s->lookahead -= n;
+            s->strstart += n;
+            bflush = _tr_tally_lits(s, scan, n);
         }
         if (bflush) FLUSH_BLOCK(s, 0);
     }
@@ -2259,6 +3235,7 @@ local block_state deflate_huff(s, flush)
     int flush;
 {
     int bflush;             /* set if current block must be flushed */
+    uInt n;                 /* number of literals to output */
 
     for (;;) {
         /* Make sure that we have a literal to write. */
@@ -2271,12 +3248,18 @@ local block_state deflate_huff(s, flush)
             }
         }
 
-        /* Output a literal byte */
+        /* Output the literal bytes up to the next check for the end of the
+         * block at once.
+         */
         s->match_length = 0;
-        Tracevv((stderr,"%c", s->window[s->strstart]));
-        _tr_tally_lit(s, s->window[s->strstart], bflush);
-        s->lookahead--;
-        s->strstart++;
+        n = SPLIT_CHECK - (s->sym_next & (SPLIT_CHECK - 1));
+        if (n > s->sym_end - s->sym_next)
+            n = s->sym_end - s->sym_next;
+        if (n > s->lookahead)
+            n = s->lookahead;
+        s->lookahead -= n;
+        s->strstart += n;
+        bflush = _tr_tally_lits(s, s->window + s->strstart - n, n);
         if (bflush) FLUSH_BLOCK(s, 0);
     }
     s->insert = 0;
@@ -14,6 +14,7 @@
 #define DEFLATE_H
 
 #include "zutil.h"
+#include <stdint.h>
 
 /* define NO_GZIP when compiling if you want to disable gzip header and
    trailer creation by deflate().  NO_GZIP would be used to avoid linking in
@@ -48,9 +49,34 @@
 #define MAX_BITS 15
 /* All codes must not exceed MAX_BITS bits */
 
-#define Buf_size 16
+#define Buf_size 64
 /* size of bit buffer in bi_buf */
 
+#define SPLIT_TYPES 10
+/* number of symbol classes observed for block splitting: eight literal
+ * classes and two match length classes */
+
+#define SPLIT_CHECK 512
+/* consider ending the block after every SPLIT_CHECK symbols (power of 2) */
+
+#define SPLIT_MIN_LENGTH 5000
+/* do not end blocks that cover fewer input bytes than this early */
+
+#define STORED_RUN 16384
+/* incompressible input is copied in stored blocks of this many bytes */
+
+#define FLAT_HISTOGRAM(sumsq, n) \
+    ((sumsq) <= 9 * (ulg)(n) * (n) / 2048 + (n))
+/* True if n byte counts whose squares sum up to sumsq are close to uniform:
+ * random bytes give n + n*(n-1)/256 on average, 1/8 of the n*n/256 part is
+ * allowed on top of that. n must not exceed 16384.
+ */
+
+#define LIT_BUFS 5
+/* pending_buf is allocated as lit_bufsize * LIT_BUFS bytes. Pending output
+ * may use the first four fifths and the 32-bit sym_buf records overlay the
+ * last four fifths. */
+
 #define INIT_STATE    42    /* zlib header -> BUSY_STATE */
 #ifdef GZIP
 #  define GZIP_STATE  57    /* gzip header -> BUSY_STATE | EXTRA_STATE */
@@ -89,14 +115,31 @@ typedef struct tree_desc_s {
     const static_tree_desc *stat_desc;  /* the corresponding static tree */
 } FAR tree_desc;
 
+#ifdef POS32
+typedef uint32_t Pos;
+#else
 typedef ush Pos;
+#endif
 typedef Pos FAR Posf;
 typedef unsigned IPos;
 
 /* A Pos is an index in the character window. We use short instead of int to
  * save space in the various tables. IPos is used only for parameter passing.
+ * If POS32 is defined, the hash tables hold 32-bit window indices plus
+ * pos_base instead, so that sliding the window only has to add w_size to
+ * pos_base. The tables are then rebased once every POS_REBASE bytes instead
+ * of at each slide.
  */
 
+#ifdef POS32
+#  define POS_BASE(s) ((s)->pos_base)
+#  ifndef POS_REBASE
+#    define POS_REBASE 0x80000000UL
+#  endif
+#else
+#  define POS_BASE(s) 0
+#endif
+
 typedef struct internal_state {
     z_streamp strm;      /* pointer back to this zlib stream */
     int   status;        /* as the name implies */
@@ -125,7 +168,13 @@ typedef struct internal_state {
      * wSize-MAX_MATCH bytes, but this ensures that IO is always
      * performed with a length multiple of the block size. Also, it limits
      * the window size to 64K, which is quite useful on MSDOS.
-     * To do: use the user input buffer as sliding window.
+     * When deflate() is given the whole input at once, window points into
+     * the user input buffer instead, see zero_copy_start() in deflate.c.
+     */
+
+    Bytef *window_buf;
+    /* Allocated sliding window. window is equal to window_buf except during
+     * a deflate() call that compresses the input in place.
      */
 
     ulg window_size;
@@ -141,6 +190,29 @@ typedef struct internal_state {
 
     Posf *head; /* Heads of the hash chains or NIL. */
 
+    Posf *head3;
+    /* Most recent search position for each hash of its first MIN_MATCH
+     * bytes, or NIL. head[] is keyed on four bytes where the CRC hash is
+     * used, so this table recovers the 3-byte matches it cannot find.
+     */
+
+    int lazy_clear;
+    /* True if every string in head[] can be found again by hashing the
+     * window up to strstart + lookahead, so that lm_init() may clear only
+     * those buckets. A string hashed with bytes past the end of the input,
+     * which later input or a slide overwrites, would be missed. Strings are
+     * hashed that way only when the input was flushed or after a dictionary,
+     * so these and a slide fall back to clearing all of head[].
+     */
+
+#ifdef POS32
+    uInt pos_base;
+    /* Value added to the window indices stored in the hash tables: the
+     * number of bytes the window was slid since the last rebase. A stored
+     * position that is not greater than pos_base is NIL.
+     */
+#endif
+
     uInt  ins_h;          /* hash index of string to be inserted */
     uInt  hash_size;      /* number of elements in hash table */
     uInt  hash_bits;      /* log2(hash_size) */
@@ -176,6 +248,15 @@ typedef struct internal_state {
      * speed.
      */
 
+    uInt chain_limit;
+    /* Hash chain length searched by deflate_slow(), adapted between
+     * max_chain_length >> CHAIN_FLOOR_SHIFT and max_chain_length to how much
+     * the searches gain from the chain steps past its first quarter.
+     */
+    uInt chain_calls;   /* searches since chain_limit was last adapted */
+    uInt chain_work;    /* chain steps of those searches past the quarter */
+    uInt chain_gain;    /* match bytes gained by those steps */
+
     uInt max_lazy_match;
     /* Attempt to find a better match only when the current match is strictly
      * smaller than this value. This mechanism is used only for compression
@@ -190,6 +271,19 @@ typedef struct internal_state {
     int level;    /* compression level (1..9) */
     int strategy; /* favor or force Huffman coding*/
 
+    int rsyncable;      /* true for Z_RSYNCABLE */
+    uInt rsync_hash;    /* rolling hash of the last 32 input bytes */
+    uInt rsync_run;     /* bytes hashed since the last reset point */
+    uInt rsync_seen;    /* bytes at next_in hashed already */
+    int rsync_hit;      /* true if a reset point follows those bytes */
+
+    int rate;           /* target rate in MB/s for deflateRate(), or 0 */
+    int rate_rung;      /* rung of the level ladder to move to */
+    int rate_strategy;  /* strategy of the ladder's levels 1..9 */
+    ulg rate_usec;      /* microseconds spent compressing since rate_in */
+    uLong rate_in;      /* total_in at the start of the measurement */
+    uLong rate_out;     /* total_out at the start of the measurement */
+
     uInt good_match;
     /* Use a faster search when the previous match is longer than this */
 
@@ -208,19 +302,19 @@ typedef struct internal_state {
     ush bl_count[MAX_BITS+1];
     /* number of codes at each bit length for an optimal tree */
 
-    int heap[2*L_CODES+1];      /* heap used to build the Huffman trees */
-    int heap_len;               /* number of elements in the heap */
-    int heap_max;               /* element of largest frequency */
-    /* The sons of heap[n] are heap[2*n] and heap[2*n+1]. heap[0] is not used.
-     * The same heap array is used to build all trees.
+    uint32_t len_bits[MAX_MATCH-MIN_MATCH+1];
+    /* Length code and extra bits for each match length - MIN_MATCH, built by
+     * compress_block() from the tree in use: the bit count is in the top
+     * byte and the bits to send, extra bits already shifted above the code,
+     * are in the low 24 bits.
      */
 
-    uch depth[2*L_CODES+1];
-    /* Depth of each subtree used as tie breaker for trees of equal frequency
+    uint32_t *sym_buf;    /* buffer for distances and literals/lengths */
+    /* Each symbol is one 32-bit record: the match distance in the low 16 bits
+     * (zero for a literal), the literal or match length - MIN_MATCH in the
+     * next 8 bits and, for a match, the distance code in the top 8 bits.
      */
 
-    uchf *sym_buf;        /* buffer for distances and literals/lengths */
-
     uInt  lit_bufsize;
     /* Size of match buffer for literals/lengths.  There are 4 reasons for
      * limiting lit_bufsize to 64K:
@@ -241,9 +335,12 @@ typedef struct internal_state {
      *   - I can't count above 4
      */
 
-    uInt sym_next;      /* running index in sym_buf */
+    uInt sym_next;      /* number of symbols in sym_buf */
     uInt sym_end;       /* symbol table full when sym_next reaches this */
 
+    uInt split_obs[SPLIT_TYPES]; /* symbol classes up to the last check */
+    int incompressible; /* true to store the input without LZ parsing */
+
     ulg opt_len;        /* bit length of current block with optimal trees */
     ulg static_len;     /* bit length of current block with static trees */
     uInt matches;       /* number of string matches in current block */
@@ -254,9 +351,9 @@ typedef struct internal_state {
     ulg bits_sent;      /* bit length of compressed data sent mod 2^32 */
 #endif
 
-    ush bi_buf;
+    uint64_t bi_buf;
     /* Output buffer. bits are inserted starting at the bottom (least
-     * significant bits).
+     * significant bits). It is written to pending_buf eight bytes at a time.
      */
     int bi_valid;
     /* Number of valid bits in bi_buf.  All bits above the last valid bit
@@ -302,6 +399,25 @@ typedef struct internal_state {
 }
 #endif
 
+/* ===========================================================================
+ * Output a 64-bit value LSB first on the stream.
+ * IN assertion: there is enough room in pendingBuf.
+ */
+#ifdef UNALIGNED_OK
+#define put_uint64(s, w) { \
+    uint64_t w64 = (w); \
+    zmemcpy_8(&s->pending_buf[s->pending], &w64); \
+    s->pending += 8; \
+}
+#else
+#define put_uint64(s, w) { \
+    put_short(s, (ush)(w)); \
+    put_short(s, (ush)((w) >> 16)); \
+    put_short(s, (ush)((w) >> 32)); \
+    put_short(s, (ush)((w) >> 48)); \
+}
+#endif
+
 #define MIN_LOOKAHEAD (MAX_MATCH+MIN_MATCH+1)
 /* Minimum amount of lookahead, except at the end of the input file.
  * See deflate.c for comments about the MIN_MATCH+1.
@@ -316,9 +432,33 @@ typedef struct internal_state {
 /* Number of bytes after end of data in window to initialize in order to avoid
    memory checker errors from longest match routines */
 
+#define WIN_PAD 16
+/* Number of bytes allocated after the window for the wide loads of the
+   SIMD routines */
+
+#ifndef RSYNC_BITS
+#  define RSYNC_BITS 16
+#endif
+#define RSYNC_MIN (1 << (RSYNC_BITS - 2))
+/* Z_RSYNCABLE places a reset point on average every 1 << RSYNC_BITS bytes,
+   and no closer than RSYNC_MIN bytes after the previous one */
+
+#define HASH3_BITS 12
+#define HASH3_SIZE (1 << HASH3_BITS)
+/* Size of the head3[] table of 3-byte match candidates */
+
+        /* in deflate.c */
+void ZLIB_INTERNAL slide_window OF((deflate_state *s, unsigned size));
+#ifdef POS32
+void ZLIB_INTERNAL slide_pos OF((deflate_state *s));
+#endif
+
         /* in trees.c */
 void ZLIB_INTERNAL _tr_init OF((deflate_state *s));
 int ZLIB_INTERNAL _tr_tally OF((deflate_state *s, unsigned dist, unsigned lc));
+int ZLIB_INTERNAL _tr_tally_lits OF((deflate_state *s, const Bytef *buf,
+                                     unsigned len));
+int ZLIB_INTERNAL _tr_split_block OF((deflate_state *s));
 void ZLIB_INTERNAL _tr_flush_block OF((deflate_state *s, charf *buf,
                         ulg stored_len, int last));
 void ZLIB_INTERNAL _tr_flush_bits OF((deflate_state *s));
@@ -346,22 +486,22 @@ void ZLIB_INTERNAL _tr_stored_block OF((deflate_state *s, charf *buf,
 
 # define _tr_tally_lit(s, c, flush) \
   { uch cc = (c); \
-    s->sym_buf[s->sym_next++] = 0; \
-    s->sym_buf[s->sym_next++] = 0; \
-    s->sym_buf[s->sym_next++] = cc; \
+    s->sym_buf[s->sym_next++] = (uint32_t)cc << 16; \
     s->dyn_ltree[cc].Freq++; \
-    flush = (s->sym_next == s->sym_end); \
+    flush = (s->sym_next == s->sym_end || \
+             ((s->sym_next & (SPLIT_CHECK - 1)) == 0 && _tr_split_block(s))); \
    }
 # define _tr_tally_dist(s, distance, length, flush) \
   { uch len = (uch)(length); \
     ush dist = (ush)(distance); \
-    s->sym_buf[s->sym_next++] = (uch)dist; \
-    s->sym_buf[s->sym_next++] = (uch)(dist >> 8); \
-    s->sym_buf[s->sym_next++] = len; \
-    dist--; \
+    ush dm1 = dist - 1; \
+    uch dcode = d_code(dm1); \
+    s->sym_buf[s->sym_next++] = dist | ((uint32_t)len << 16) | \
+                                ((uint32_t)dcode << 24); \
     s->dyn_ltree[_length_code[len]+LITERALS+1].Freq++; \
-    s->dyn_dtree[d_code(dist)].Freq++; \
-    flush = (s->sym_next == s->sym_end); \
+    s->dyn_dtree[dcode].Freq++; \
+    flush = (s->sym_next == s->sym_end || \
+             ((s->sym_next & (SPLIT_CHECK - 1)) == 0 && _tr_split_block(s))); \
   }
 #else
 # define _tr_tally_lit(s, c, flush) flush = _tr_tally(s, 0, c)
@@ -377,4 +517,13 @@ void ZLIB_INTERNAL _tr_stored_block OF((deflate_state *s, charf *buf,
  */
 #define UPDATE_HASH_C(s,h,c) (h = (((h)<<s->hash_shift) ^ (c)) & s->hash_mask)
 
+/* ===========================================================================
+ * Set h to the hash of the four bytes read as the unsigned v. The crc32
+ * instruction hashes are replaced by this one if ZLIB_DETERMINISTIC is
+ * defined, and then all CPUs, with or without SSE4.2, build the same hash
+ * chains and so produce the same compressed output.
+ */
+#define UPDATE_HASH_MUL(s,h,v) \
+    (h = ((unsigned)(v) * 2654435761U) >> (32 - (s)->hash_bits))
+
 #endif /* DEFLATE_H */
@@ -96,6 +96,7 @@ local gzFile gz_open(path, fd, mode)
     gz_statep state;
     z_size_t len;
     int oflag;
+    int rsyncable = 0;
 #ifdef O_CLOEXEC
     int cloexec = 0;
 #endif
@@ -166,11 +167,16 @@ local gzFile gz_open(path, fd, mode)
             case 'T':
                 state->direct = 1;
                 break;
+            case 'y':
+                rsyncable = 1;
+                break;
             default:        /* could consider as an error, but just ignore */
                 ;
             }
         mode++;
     }
+    if (rsyncable)
+        state->strategy |= Z_RSYNCABLE;
 
     /* must provide an "r", "w", or "a" */
     if (state->mode == GZ_NONE) {
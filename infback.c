@@ -14,6 +14,10 @@
 #include "inftrees.h"
 #include "inflate.h"
 #include "inffast.h"
+#include "chunkset.h"
+#if defined(_M_IX86) || defined(_M_AMD64)
+#include "arch/x86/x86.h"
+#endif
 
 /* function prototypes */
 local void fixedtables OF((struct inflate_state FAR *state));
@@ -67,6 +71,36 @@ int stream_size;
     state->wnext = 0;
     state->whave = 0;
     state->sane = 1;
+#if defined(_M_IX86) || defined(_M_AMD64)
+    state->chunksize = chunksize_sse2();
+#else
+    state->chunksize = chunksize_c();
+#endif
+    return Z_OK;
+}
+
+/*
+   Replace the window and output buffer with buf[0..size-1], which must be at
+   least as large as the window requested from inflateBackInit().  The buffer
+   is used circularly like the window, so that matches can reach back into
+   the data already written out, and out() is called each time it is full.
+ */
+int ZEXPORT inflateBackBuffer(strm, buf, size)
+z_streamp strm;
+unsigned char FAR *buf;
+unsigned size;
+{
+    struct inflate_state FAR *state;
+
+    if (strm == Z_NULL || strm->state == Z_NULL || buf == Z_NULL)
+        return Z_STREAM_ERROR;
+    state = (struct inflate_state FAR *)strm->state;
+    if (size < (1U << state->wbits))
+        return Z_STREAM_ERROR;
+    state->window = buf;
+    state->wsize = size;
+    state->wnext = 0;
+    state->whave = 0;
     return Z_OK;
 }
 
@@ -482,7 +516,7 @@ void FAR *out_desc;
 
         case LEN:
             /* use inflate_fast() if we have enough input and output */
-            if (have >= 6 && left >= 258) {
+            if (have >= INFLATE_FAST_MIN_HAVE && left >= INFLATE_FAST_MIN_LEFT) {
                 RESTORE();
                 if (state->whave < state->wsize)
                     state->whave = state->wsize - left;
@@ -491,6 +525,19 @@ void FAR *out_desc;
                 break;
             }
 
+            /* otherwise decode what the remaining input and output allow,
+               leaving a symbol that is cut off by the end of the input or a
+               literal that needs more room to the code below */
+            if (left != 0) {
+                RESTORE();
+                if (state->whave < state->wsize)
+                    state->whave = state->wsize - left;
+                inflate_fast_safe(strm, state->wsize);
+                LOAD();
+                if (state->mode != LEN)
+                    break;
+            }
+
             /* get a literal, length, or end-of-block code */
             for (;;) {
                 here = state->lencode[BITS(state->lenbits)];
@@ -583,7 +630,10 @@ void FAR *out_desc;
                 break;
             }
             Tracevv((stderr, "inflate:         distance %u\n", state->offset));
+            state->mode = MATCH;
+                /* fallthrough */
 
+        case MATCH:
             /* copy match from window to output */
             do {
                 ROOM();
@@ -603,6 +653,7 @@ void FAR *out_desc;
                     *put++ = *from++;
                 } while (--copy);
             } while (state->length != 0);
+            state->mode = LEN;
             break;
 
         case DONE:
@@ -137,6 +137,8 @@ unsigned start;         /* inflate()'s starting value for strm->avail_out */
     unsigned dist;              /* match distance */
     unsigned char *from;        /* where to copy match from */
     unsigned extra_safe;        /* copy chunks safely in all cases */
+    unsigned fastmask;          /* ~0 if in-output copies may overrun, else 0 */
+    unsigned chunksize;         /* local state->chunksize */
 
     /* copy state to local variables */
     state = (struct inflate_state *)strm->state;
@@ -165,6 +167,11 @@ unsigned start;         /* inflate()'s starting value for strm->avail_out */
        window is overwritten then future matches with far distances will fail to copy correctly. */
     extra_safe = (wsize != 0 && out >= window && out + INFLATE_FAST_MIN_LEFT <= window + wsize);
 
+    /* Fold extra_safe into the distance test so that the common case, a match
+       entirely within the output written so far, costs a single branch. */
+    fastmask = extra_safe ? 0 : ~0U;
+    chunksize = state->chunksize;
+
     /* decode literals and length/distances until end-of-block or not enough
        input data or output space */
     do {
@@ -220,7 +227,26 @@ unsigned start;         /* inflate()'s starting value for strm->avail_out */
                 DROPBITS(op);
                 Tracevv((stderr, "inflate:         distance %u\n", dist));
                 op = (unsigned)(out - beg);     /* max distance in output */
-                if (dist > op) {                /* see if copy from window */
+                if (LIKELY(dist <= (op & fastmask))) {
+                    /* Whole reference is in range of current output.  No range checks are
+                       necessary because we start with room for at least 258 bytes of output,
+                       so unroll and roundoff operations can write beyond `out+len` so long
+                       as they stay within 258 bytes of `out`.
+                    */
+                    from = out - dist;
+                    if (dist >= MIN(len, chunksize))
+#if defined(_M_IX86) || defined(_M_AMD64)
+                        out = chunkcopy_sse2(out, from, len);
+#else
+                        out = chunkcopy_c(out, from, len);
+#endif
+                    else
+#if defined(_M_IX86) || defined(_M_AMD64)
+                        out = chunkmemset_sse2(out, dist, len);
+#else
+                        out = chunkmemset_c(out, dist, len);
+#endif
+                } else if (dist > op) {         /* see if copy from window */
                     op = dist - op;             /* distance back in window */
                     if (op > whave) {
                         if (state->sane) {
@@ -277,33 +303,16 @@ unsigned start;         /* inflate()'s starting value for strm->avail_out */
                     } else {
                         out = chunkcopy_safe(out, from, len, safe);
                     }
-                } else if (extra_safe) {
-                    /* Whole reference is in range of current output. */
-                    if (dist >= len || dist >= state->chunksize)
+                } else {
+                    /* Whole reference is in range of current output, but the output is
+                       inside the window, so copy without writing past `out+len`. */
+                    if (dist >= MIN(len, chunksize))
                         out = chunkcopy_safe(out, out - dist, len, safe);
                     else
 #if defined(_M_IX86) || defined(_M_AMD64)
                         out = chunkmemset_safe_sse2(out, dist, len, (unsigned)((safe - out) + 1));
 #else
                         out = chunkmemset_safe_c(out, dist, len, (unsigned) ((safe - out) + 1));
-#endif
-                } else {
-                    /* Whole reference is in range of current output.  No range checks are
-                       necessary because we start with room for at least 258 bytes of output,
-                       so unroll and roundoff operations can write beyond `out+len` so long
-                       as they stay within 258 bytes of `out`.
-                    */
-                    if (dist >= len || dist >= state->chunksize)
-#if defined(_M_IX86) || defined(_M_AMD64)
-                        out = chunkcopy_sse2(out, out - dist, len);
-#else
-                        out = chunkcopy_c(out, out - dist, len);
-#endif
-                    else
-#if defined(_M_IX86) || defined(_M_AMD64)
-                        out = chunkmemset_sse2(out, dist, len);
-#else
-                        out = chunkmemset_c(out, dist, len);
 #endif
                 }
             } else if ((op & 64) == 0) {          /* 2nd level distance code */
@@ -359,3 +368,272 @@ unsigned start;         /* inflate()'s starting value for strm->avail_out */
    - Larger unrolled copy loops (three is about right)
    - Moving len -= 3 statement into middle of loop
  */
+
+/*
+   Decode literal, length, and distance codes like inflate_fast(), but for the
+   tails of the input and output buffers where inflate_fast() cannot be used.
+   This takes the place of the byte-at-a-time LEN .. MATCH states of inflate()
+   whenever strm->avail_in < INFLATE_FAST_MIN_HAVE or strm->avail_out <
+   INFLATE_FAST_MIN_LEFT, which is the common case for streaming consumers
+   that are fed small packets.
+
+   Entry assumptions:
+
+        state->mode == LEN
+        start >= strm->avail_out
+        state->bits <= 32
+
+   On return, state->mode is one of:
+
+        LEN -- the next symbol needs more input than is available, or there
+               is no output space left
+        MATCH -- a match did not fit in the remaining output space, the rest
+                 of it is described by state->length and state->offset
+        TYPE -- reached end of block code, inflate() to interpret next block
+        BAD -- error in block data
+
+   Notes:
+
+    - The bit accumulator is 64 bits wide, and is refilled eight bytes at a
+      time while there are at least eight bytes of input, otherwise one byte
+      at a time up to the end of the input.  After a refill there are at
+      least 56 bits available unless the input is exhausted, which is enough
+      for a complete length/distance pair (48 bits).
+
+    - A symbol is only consumed once all of its bits are in the accumulator,
+      so when the input runs out in the middle of a symbol, the state is left
+      at LEN and inflate() picks up the partial symbol with its own state
+      machine.
+
+    - Match copies are bounded by the available output and done in chunks.
+      If a match does not fit, as much of it as fits is copied and the
+      remainder is left to the MATCH state of inflate().
+ */
+void ZLIB_INTERNAL inflate_fast_safe(strm, start)
+z_streamp strm;
+unsigned start;         /* inflate()'s starting value for strm->avail_out */
+{
+    struct inflate_state *state;
+    z_const unsigned char *in;  /* local strm->next_in */
+    z_const unsigned char *first; /* strm->next_in on entry */
+    z_const unsigned char *last;  /* end of available input */
+    unsigned char *out;         /* local strm->next_out */
+    unsigned char *beg;         /* inflate()'s initial strm->next_out */
+    unsigned char *safe;        /* end of available output */
+    unsigned left;              /* available output */
+#ifdef INFLATE_STRICT
+    unsigned dmax;              /* maximum distance from zlib header */
+#endif
+    unsigned wsize;             /* window size or zero if not using window */
+    unsigned whave;             /* valid bytes in the window */
+    unsigned wnext;             /* window write index */
+    unsigned char *window;      /* allocated sliding window, if wsize != 0 */
+    uint64_t hold;              /* local strm->hold */
+    unsigned bits;              /* local strm->bits */
+    code const *lcode;          /* local strm->lencode */
+    code const *dcode;          /* local strm->distcode */
+    unsigned lmask;             /* mask for first level of length codes */
+    unsigned dmask;             /* mask for first level of distance codes */
+    code here;                  /* retrieved table entry */
+    unsigned need;              /* bits used by the current symbol */
+    unsigned op;                /* code bits, operation, extra bits, or */
+                                /*  window position, window bytes to copy */
+    unsigned len;               /* match length */
+    unsigned dist;              /* match distance */
+    unsigned copy;              /* bytes of the match to copy now */
+    unsigned char *from;        /* where to copy match from */
+
+    /* copy state to local variables */
+    state = (struct inflate_state *)strm->state;
+    in = first = strm->next_in;
+    last = in + strm->avail_in;
+    out = strm->next_out;
+    left = strm->avail_out;
+    beg = out - (start - left);
+    safe = out + left;
+#ifdef INFLATE_STRICT
+    dmax = state->dmax;
+#endif
+    wsize = state->wsize;
+    whave = state->whave;
+    wnext = state->wnext;
+    window = state->window;
+    hold = state->hold;
+    bits = state->bits;
+    lcode = state->lencode;
+    dcode = state->distcode;
+    lmask = (1U << state->lenbits) - 1;
+    dmask = (1U << state->distbits) - 1;
+
+    /* decode literals and length/distances until end-of-block, not enough
+       input for the next symbol, or no output space */
+    while (left != 0) {
+        /* refill, see inflate_fast() for the 64-bit load */
+        if (last - in >= 8) {
+            hold |= load_64_bits(in, bits);
+            in += (63 - bits) >> 3;
+            bits |= 56;
+        } else {
+            while (bits <= 56 && in < last) {
+                hold |= (uint64_t)(*in++) << bits;
+                bits += 8;
+            }
+        }
+
+        /* length or literal code */
+        here = lcode[hold & lmask];
+        if (here.op && (here.op & 0xf0) == 0) { /* 2nd level length code */
+            need = here.bits;
+            here = lcode[here.val + ((unsigned)(hold >> need) &
+                                     ((1U << here.op) - 1))];
+            need += here.bits;
+        } else
+            need = here.bits;
+        if (need > bits) break;
+
+        op = here.op;
+        if (op == 0) {                          /* literal */
+            Tracevv((stderr, here.val >= 0x20 && here.val < 0x7f ?
+                    "inflate:         literal '%c'\n" :
+                    "inflate:         literal 0x%02x\n", here.val));
+            DROPBITS(need);
+            *out++ = (unsigned char)(here.val);
+            left--;
+            continue;
+        }
+        if (op & 32) {                          /* end-of-block */
+            Tracevv((stderr, "inflate:         end of block\n"));
+            DROPBITS(need);
+            state->mode = TYPE;
+            break;
+        }
+        if (op & 64) {
+            SET_BAD("invalid literal/length code");
+            break;
+        }
+
+        /* length base and extra bits */
+        len = here.val;
+        op &= 15;
+        if (need + op > bits) break;
+        len += (unsigned)(hold >> need) & ((1U << op) - 1);
+        need += op;
+
+        /* distance code */
+        here = dcode[(hold >> need) & dmask];
+        if ((here.op & 0xf0) == 0) {            /* 2nd level distance code */
+            op = need + here.bits;
+            here = dcode[here.val + ((unsigned)(hold >> op) &
+                                     ((1U << here.op) - 1))];
+            op += here.bits;
+        } else
+            op = need + here.bits;
+        if (op > bits) break;
+        if (here.op & 64) {
+            SET_BAD("invalid distance code");
+            break;
+        }
+        need = op;
+
+        /* distance base and extra bits */
+        dist = here.val;
+        op = here.op & 15;
+        if (need + op > bits) break;
+        dist += (unsigned)(hold >> need) & ((1U << op) - 1);
+        need += op;
+#ifdef INFLATE_STRICT
+        if (dist > dmax) {
+            SET_BAD("invalid distance too far back");
+            break;
+        }
+#endif
+        Tracevv((stderr, "inflate:         length %u\n", len));
+        Tracevv((stderr, "inflate:         distance %u\n", dist));
+
+        /* the whole symbol is available, consume it and copy the match */
+        DROPBITS(need);
+        state->was = len;
+        copy = MIN(len, left);
+        op = (unsigned)(out - beg);             /* max distance in output */
+        if (dist > op) {                        /* see if copy from window */
+            op = dist - op;                     /* distance back in window */
+            if (op > whave) {
+                if (state->sane) {
+                    SET_BAD("invalid distance too far back");
+                    break;
+                }
+                /* let inflate() fill in the invalid distance */
+                copy = 0;
+            } else {
+                from = window;
+                if (wnext >= op) {              /* contiguous in window */
+                    from += wnext - op;
+                } else {                        /* wrap around window */
+                    op -= wnext;
+                    from += wsize - op;
+                    if (op < copy) {            /* some from end of window */
+                        out = chunkcopy_safe(out, from, op, safe);
+                        len -= op;
+                        left -= op;
+                        copy -= op;
+                        from = window;          /* more from start of window */
+                        op = wnext;
+                    }
+                }
+                if (op < copy) {                /* still need some from output */
+                    out = chunkcopy_safe(out, from, op, safe);
+                    len -= op;
+                    left -= op;
+                    copy -= op;
+                } else {
+                    out = chunkcopy_safe(out, from, copy, safe);
+                    len -= copy;
+                    left -= copy;
+                    copy = 0;
+                }
+            }
+        }
+        if (copy) {                             /* copy from output */
+            /* neither copy writes past out + copy, which matters when the
+               output is the window, as for inflateBack() */
+            if (dist >= copy)
+                out = chunkcopy_safe(out, out - dist, copy, safe);
+            else
+#if defined(_M_IX86) || defined(_M_AMD64)
+                out = chunkmemset_safe_sse2(out, dist, copy, left);
+#else
+                out = chunkmemset_safe_c(out, dist, copy, left);
+#endif
+            len -= copy;
+            left -= copy;
+        }
+        if (len) {
+            /* out of output space or invalid distance, inflate() or
+               inflateBack() finishes the match from its MATCH state */
+            state->length = len;
+            state->offset = dist;
+            state->back = (int)need;
+            state->mode = MATCH;
+            break;
+        }
+    }
+
+    /* return unused bytes, but only those read by this call */
+    len = bits >> 3;
+    if (len > (unsigned)(in - first))
+        len = (unsigned)(in - first);
+    in -= len;
+    bits -= len << 3;
+    hold &= (UINT64_C(1) << bits) - 1;
+
+    /* update state and return */
+    strm->next_in = in;
+    strm->next_out = out;
+    strm->avail_in = (unsigned)(last - in);
+    strm->avail_out = left;
+
+    Assert(bits <= 32, "Remaining bits greater than 32");
+    state->hold = (unsigned long)hold;
+    state->bits = bits;
+    return;
+}
@@ -87,6 +87,8 @@
 #include "chunkset.h"
 #if defined(_M_IX86) || defined(_M_AMD64)
 #include "arch/x86/x86.h"
+#elif defined(_M_ARM64)
+#include "arch/aarch64/aarch64.h"
 #endif
 
 #ifdef MAKEFIXED
@@ -103,6 +105,7 @@ local int updatewindow OF((z_streamp strm, const unsigned char FAR *end,
 #ifdef BUILDFIXED
    void makefixed OF((void));
 #endif
+local z_size_t syncscan OF((const unsigned char FAR *buf, z_size_t len));
 local unsigned syncsearch OF((unsigned FAR *have, const unsigned char FAR *buf,
                               unsigned len));
 
@@ -234,7 +237,9 @@ int stream_size;
     state->strm = strm;
     state->window = Z_NULL;
     state->mode = HEAD;     /* to pass state test in inflateReset2() */
+    state->tabused = 0;
 #if defined(_M_IX86) || defined(_M_AMD64)
+    x86_check_features();
     state->chunksize = chunksize_sse2();
 #else
     state->chunksize = chunksize_c();
@@ -968,7 +973,12 @@ int flush;
             }
             while (state->have < 19)
                 state->lens[order[state->have++]] = 0;
-            state->next = state->codes;
+
+            /* build the code lengths table after the last dynamic tables if
+               there is room, so that those can still be reused */
+            if (state->tabused > ENOUGH - ENOUGH_CODES)
+                state->tabused = 0;
+            state->next = state->codes + state->tabused;
             state->lencode = (const code FAR *)(state->next);
             state->lenbits = 7;
             ret = inflate_table(CODES, state->lens, 19, &(state->next),
@@ -1040,9 +1050,29 @@ int flush;
                 break;
             }
 
+            /* reuse the last dynamic code tables if they were built from the
+               same code lengths, which is common when a compressor emits many
+               small blocks of similar data */
+            if (state->tabused != 0 && state->tabnlen == state->nlen &&
+                state->tabndist == state->ndist &&
+                zmemcmp(state->tablens, state->lens,
+                        (state->nlen + state->ndist) *
+                        sizeof(unsigned short)) == 0) {
+                state->lencode = (const code FAR *)(state->codes);
+                state->lenbits = state->tablenbits;
+                state->distcode = (const code FAR *)(state->codes +
+                                                     state->tabdist);
+                state->distbits = state->tabdistbits;
+                Tracev((stderr, "inflate:       codes reused\n"));
+                state->mode = LEN_;
+                if (flush == Z_TREES) goto inf_leave;
+                break;
+            }
+
             /* build code tables -- note: do not change the lenbits or distbits
                values here (9 and 6) without reading the comments in inftrees.h
                concerning the ENOUGH constants, which depend on those values */
+            state->tabused = 0;
             state->next = state->codes;
             state->lencode = (const code FAR *)(state->next);
             state->lenbits = 9;
@@ -1062,6 +1092,14 @@ int flush;
                 state->mode = BAD;
                 break;
             }
+            state->tabused = (unsigned)(state->next - state->codes);
+            state->tabnlen = state->nlen;
+            state->tabndist = state->ndist;
+            state->tabdist = (unsigned)(state->distcode - state->codes);
+            state->tablenbits = state->lenbits;
+            state->tabdistbits = state->distbits;
+            zmemcpy(state->tablens, state->lens,
+                    (state->nlen + state->ndist) * sizeof(unsigned short));
             Tracev((stderr, "inflate:       codes ok\n"));
             state->mode = LEN_;
             if (flush == Z_TREES) goto inf_leave;
@@ -1078,6 +1116,16 @@ int flush;
                     state->back = -1;
                 break;
             }
+            if (left != 0) {
+                RESTORE();
+                inflate_fast_safe(strm, out);
+                LOAD();
+                if (state->mode != LEN) {
+                    if (state->mode == TYPE)
+                        state->back = -1;
+                    break;
+                }
+            }
             state->back = 0;
             for (;;) {
                 here = state->lencode[BITS(state->lenbits)];
@@ -1381,6 +1429,34 @@ uInt dictLength;
     return Z_OK;
 }
 
+int ZEXPORT inflateSetPreparedDictionary(strm, dict)
+z_streamp strm;
+z_dictp dict;
+{
+    struct inflate_state FAR *state;
+    int ret;
+
+    /* check state */
+    if (inflateStateCheck(strm) || dict == Z_NULL) return Z_STREAM_ERROR;
+    state = (struct inflate_state FAR *)strm->state;
+    if (state->wrap != 0 && state->mode != DICT)
+        return Z_STREAM_ERROR;
+
+    /* check the dictionary identifier computed when dict was prepared */
+    if (state->mode == DICT && dict->dictid != state->check)
+        return Z_DATA_ERROR;
+
+    /* copy the tail of the dictionary to the window */
+    ret = updatewindow(strm, dict->window + dict->length, dict->length);
+    if (ret) {
+        state->mode = MEM;
+        return Z_MEM_ERROR;
+    }
+    state->havedict = 1;
+    Tracev((stderr, "inflate:   prepared dictionary set\n"));
+    return Z_OK;
+}
+
 int ZEXPORT inflateGetHeader(strm, head)
 z_streamp strm;
 gz_headerp head;
@@ -1398,6 +1474,41 @@ gz_headerp head;
     return Z_OK;
 }
 
+/*
+   Return the offset of the first 0, 0, 0xff, 0xff pattern in buf[0..len-1], or
+   len if there is none.  The pattern can only start at i if buf[i + 3] is 0xff,
+   and no pattern can start at i..i+3 if buf[i + 3] is neither 0 nor 0xff, so
+   most positions are skipped four at a time.  The SIMD versions test a whole
+   vector of positions at once.
+ */
+local z_size_t syncscan(buf, len)
+const unsigned char FAR *buf;
+z_size_t len;
+{
+#if defined(_M_IX86) || defined(_M_AMD64)
+    if (x86_cpu_has_avx2)
+        return syncscan_avx2(buf, len);
+    return syncscan_sse2(buf, len);
+#elif defined(_M_ARM64)
+    return syncscan_neon(buf, len);
+#else
+    z_size_t i;
+
+    for (i = 0; len - i >= 4;) {
+        if (buf[i + 3] == 0xff) {
+            if (buf[i] == 0 && buf[i + 1] == 0 && buf[i + 2] == 0xff)
+                return i;
+            i++;
+        }
+        else if (buf[i + 3] == 0)
+            i += 2;
+        else
+            i += 4;
+    }
+    return len;
+#endif
+}
+
 /*
    Search buf[0..len-1] for the pattern: 0, 0, 0xff, 0xff.  Return when found
    or when out of input.  When called, *have is the number of pattern bytes
@@ -1419,14 +1530,31 @@ unsigned len;
 
     got = *have;
     next = 0;
-    while (next < len && got < 4) {
-        if ((int)(buf[next]) == (got < 2 ? 0 : 0xff))
-            got++;
-        else if (buf[next])
-            got = 0;
-        else
-            got = 4 - got;
-        next++;
+    for (;;) {
+        while (next < len && got < 4) {
+            if ((int)(buf[next]) == (got < 2 ? 0 : 0xff))
+                got++;
+            else if (buf[next])
+                got = 0;
+            else
+                got = 4 - got;
+            next++;
+            if (got == 0 && len - next >= 4)
+                break;
+        }
+        if (got != 0 || len - next < 4)
+            break;
+
+        /* no partial match pending: scan ahead for a complete pattern, and
+           otherwise resume the byte search where a partial match at the end
+           of buf could start */
+        next += (unsigned)syncscan(buf + next, len - next);
+        if (next < len) {
+            got = 4;
+            next += 4;
+            break;
+        }
+        next = len - 3;
     }
     *have = got;
     return next;
@@ -1475,6 +1603,35 @@ z_streamp strm;
     return Z_OK;
 }
 
+/* ===========================================================================
+   Save in points[] the offset just past each 0, 0, 0xff, 0xff pattern in
+   buf[0..len-1], for up to max patterns, and return how many were saved.
+ */
+unsigned ZEXPORT inflateSyncScan(buf, len, points, max)
+const Bytef *buf;
+z_size_t len;
+z_size_t *points;
+unsigned max;
+{
+    z_size_t next;              /* where to continue the search */
+    unsigned n;                 /* number of points found */
+
+    if (buf == Z_NULL || points == Z_NULL)
+        return 0;
+#if defined(_M_IX86) || defined(_M_AMD64)
+    x86_check_features();
+#endif
+    next = 0;
+    for (n = 0; n < max; n++) {
+        next += syncscan(buf + next, len - next);
+        if (next == len)
+            break;
+        next += 4;
+        points[n] = next;
+    }
+    return n;
+}
+
 /*
    Returns true if inflate is currently at the end of a block generated by
    Z_SYNC_FLUSH or Z_FULL_FLUSH. This function is used by one PPP
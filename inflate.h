@@ -77,7 +77,7 @@ typedef enum {
         CHECK -> LENGTH -> DONE
  */
 
-/* State maintained between inflate() calls -- approximately 7K bytes, not
+/* State maintained between inflate() calls -- approximately 8K bytes, not
    including the allocated sliding window, which is up to 32K bytes. */
 struct inflate_state {
     z_streamp strm;             /* pointer back to this zlib stream */
@@ -119,6 +119,14 @@ struct inflate_state {
     unsigned short lens[320];   /* temporary storage for code lengths */
     unsigned short work[288];   /* work area for code table building */
     code codes[ENOUGH];         /* space for code tables */
+        /* last dynamic code tables built in codes[], reused for equal lens */
+    unsigned tabused;           /* codes[] entries they use, 0 if none */
+    unsigned tabnlen;           /* number of length code lengths */
+    unsigned tabndist;          /* number of distance code lengths */
+    unsigned tabdist;           /* offset of distance table in codes[] */
+    unsigned tablenbits;        /* index bits for the length/literal table */
+    unsigned tabdistbits;       /* index bits for the distance table */
+    unsigned short tablens[320]; /* code lengths the tables were built from */
     int sane;                   /* if false, allow invalid distance too far */
     int back;                   /* bits back of last unprocessed length/lit */
     unsigned was;               /* initial length of match */
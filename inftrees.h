@@ -50,6 +50,10 @@ typedef struct {
 #define ENOUGH_DISTS 592
 #define ENOUGH (ENOUGH_LENS+ENOUGH_DISTS)
 
+/* The code lengths code has a root table size of 7 and a maximum bit length
+   of 7, so its table is never larger than 128 entries. */
+#define ENOUGH_CODES 128
+
 /* Type of code to build for inflate_table() */
 typedef enum {
     CODES,
@@ -24,21 +24,24 @@ local uInt longest_match_slow(s, cur_match)
     deflate_state *s;
     IPos cur_match;                             /* current match */
 {
-    unsigned chain_length = s->max_chain_length;/* max hash chain length */
+    unsigned chain_length = s->chain_limit;     /* max hash chain length */
+    unsigned chain_start;                       /* chain_length to begin with */
+    int early_len;                              /* best_len in first 1/4 */
     register Bytef *scan = s->window + s->strstart; /* current string */
     register Bytef *match;                      /* matched string */
     register int len;                           /* length of current match */
     int best_len = s->prev_length;              /* ignore strings, shorter or of the same length */
     int nice_match = s->nice_match;             /* stop if match long enough */
     int offset = 0;                             /* offset of current hash chain */
-    IPos limit_base = s->strstart > (IPos)MAX_DIST(s) ?
-        s->strstart - (IPos)MAX_DIST(s) : NIL;
+    int hash_len = LONG_HASH ? 4 : MIN_MATCH;   /* bytes keying a hash chain */
+    IPos limit_base = (s->strstart > (IPos)MAX_DIST(s) ?
+        s->strstart - (IPos)MAX_DIST(s) : NIL) + POS_BASE(s);
     /*?? are MAX_DIST matches allowed ?! */
     IPos limit = limit_base;                    /* limit will be limit_base+offset */
     /* Stop when cur_match becomes <= limit. To simplify the code,
      * we prevent matches with the string of window index 0.
      */
-    Bytef *match_base = s->window;              /* s->window - offset */
+    Bytef *match_base = s->window - POS_BASE(s); /* s->window - offset */
     Bytef *match_base2;                         /* s->window + best_len-1 - offset */
     /* "offset search" mode will speedup only with large chain_length; plus it is
      * impossible for deflate_fast(), because this function does not perform
@@ -48,6 +51,7 @@ local uInt longest_match_slow(s, cur_match)
      */
     int offs0_mode = chain_length < 64;         /* bool, mode with offset==0 */
     Posf *prev = s->prev;                       /* lists of the hash chains */
+    IPos next_match;                            /* next string in the chain */
     uInt wmask = s->w_mask;
 #ifdef PARANOID_CHECK
     int match_found = 0;
@@ -78,6 +82,8 @@ local uInt longest_match_slow(s, cur_match)
     if (s->prev_length >= s->good_match) {
         chain_length >>= 2;
     }
+    chain_start = chain_length;
+    early_len = best_len;
     /* Do not look for matches beyond the end of the input. This is necessary
      * to make deflate deterministic.
      */
@@ -97,14 +103,14 @@ local uInt longest_match_slow(s, cur_match)
          */
 
 #if defined(_M_IX86) || defined(_M_AMD64)
-		if (!x86_cpu_has_sse42)
+		if (!LONG_HASH)
 		{
 			hash = scan[1];
 			UPDATE_HASH_C(s, hash, scan[2]);
 		}
 #endif
 
-        for (i = 3; i <= best_len; i++) {
+        for (i = 3; i <= best_len + MIN_MATCH - hash_len; i++) {
 			UPDATE_HASH(s, hash, scan[i]);
             /* If we're starting with best_len >= 3, we can use offset search. */
             pos = s->head[hash];
@@ -120,11 +126,17 @@ local uInt longest_match_slow(s, cur_match)
         match_base2 -= offset;
     }
 
+/* A chain ends at limit, or where it does not go back. The latter happens
+ * only after switching chains above to a string that deflate_fast() or
+ * another compression function before a deflateParams() did not insert, the
+ * slot of which in prev[] is left from an older string.
+ */
 #define NEXT_CHAIN \
-    cur_match = prev[cur_match & wmask]; \
-    if (cur_match <= limit) goto break_matching; \
+    next_match = prev[cur_match & wmask]; \
+    if (next_match <= limit || next_match >= cur_match) goto break_matching; \
+    cur_match = next_match; \
     if (--chain_length == 0) goto break_matching; \
-    Assert(cur_match - offset < s->strstart, "no future");
+    Assert(cur_match - offset - POS_BASE(s) < s->strstart, "no future");
 
     do {
         /* Find a candidate for matching using hash table. Jump over hash
@@ -183,13 +195,14 @@ local uInt longest_match_slow(s, cur_match)
             match_found = 1;
 #endif
             /* new string is longer than previous - remember it */
-            s->match_start = cur_match - offset;
+            s->match_start = cur_match - offset - POS_BASE(s);
             best_len = len;
+            if (chain_length > chain_start - (chain_start >> 2)) early_len = len;
             if (len >= nice_match) break;
             UPDATE_SCAN_END;
             /* look for better string offset */
 			/*!! TODO: check if "cur_match - offset + len < s->strstart" condition is really needed - it restricts RLE-like compression */
-            if (len > MIN_MATCH && cur_match - offset + len < s->strstart && !offs0_mode) {
+            if (len > MIN_MATCH && cur_match - offset + len < s->strstart + POS_BASE(s) && !offs0_mode) {
                 /* NOTE: if deflate algorithm will perform INSERT_STRING for
                  *   a whole scan (not for scan[0] only), can remove
                  *   "cur_match + len < s->strstart" limitation and replace it
@@ -204,7 +217,7 @@ local uInt longest_match_slow(s, cur_match)
                 cur_match -= offset;
                 offset = 0;
                 next_pos = cur_match;
-                for (i = 0; i <= len - MIN_MATCH; i++) {
+                for (i = 0; i <= len - hash_len; i++) {
                     pos = prev[(cur_match + i) & wmask];
                     if (pos < next_pos) {
                         /* this hash chain is more distant, use it */
@@ -216,16 +229,16 @@ local uInt longest_match_slow(s, cur_match)
                 /* Switch cur_match to next_pos chain */
                 cur_match = next_pos;
 
-                /* Try hash head at len-(MIN_MATCH-1) position to see if we could get
-                 * a better cur_match at the end of string. Using (MIN_MATCH-1) lets
+                /* Try hash head at len-(hash_len-1) position to see if we could get
+                 * a better cur_match at the end of string. Using (hash_len-1) lets
                  * us to include one more byte into hash - the byte which will be checked
                  * in main loop now, and which allows to grow match by 1.
                  */
                 /*hash = 0*/;
-                scan_end = scan + len - MIN_MATCH + 1;
+                scan_end = scan + len - hash_len + 1;
 				
 #if defined(_M_IX86) || defined(_M_AMD64)
-				if (!x86_cpu_has_sse42)
+				if (!LONG_HASH)
 				{
                     hash = scan_end[0];
 					UPDATE_HASH_C(s, hash, scan_end[1]);
@@ -239,14 +252,14 @@ local uInt longest_match_slow(s, cur_match)
 
                 pos = s->head[hash];
                 if (pos < cur_match) {
-                    offset = len - MIN_MATCH + 1;
+                    offset = len - hash_len + 1;
                     if (pos <= limit_base + offset) goto break_matching;
                     cur_match = pos;
                 }
 
                 /* update offset-dependent vars */
                 limit = limit_base + offset;
-                match_base = s->window - offset;
+                match_base = s->window - POS_BASE(s) - offset;
                 UPDATE_MATCH_BASE2;
                 continue;
             } else {
@@ -258,10 +271,19 @@ local uInt longest_match_slow(s, cur_match)
         }
         }
         /* follow hash chain */
-        cur_match = prev[cur_match & wmask];
-    } while (cur_match > limit && --chain_length != 0);
+        next_match = prev[cur_match & wmask];
+        if (next_match <= limit || next_match >= cur_match) break;
+        cur_match = next_match;
+    } while (--chain_length != 0);
 
 break_matching: /* sorry for goto's, but such code is smaller and easier to view ... */
+    /* Account the chain steps past the first quarter of the chain, and the
+     * match bytes they gained, to adapt chain_limit in deflate_slow().
+     */
+    if (chain_start - chain_length > chain_start >> 2) {
+        s->chain_work += chain_start - chain_length - (chain_start >> 2);
+        s->chain_gain += best_len - early_len;
+    }
 #ifdef PARANOID_CHECK
     if (match_found) {
         static int warned = 0;
@@ -275,7 +297,7 @@ break_matching: /* sorry for goto's, but such code is smaller and easier to view
             error = 1;
             printf("match too long\n");
         }
-        if (s->match_start < limit_base) {
+        if (s->match_start + POS_BASE(s) < limit_base) {
             error = 1;
             printf("too far $%X -> $%X [%d]  (dist+=%X)\n", s->strstart, s->match_start, best_len, limit_base-s->match_start);
         }
@@ -137,8 +137,9 @@ local const static_tree_desc  static_bl_desc =
 
 local void tr_static_init OF((void));
 local void init_block     OF((deflate_state *s));
-local void pqdownheap     OF((deflate_state *s, ct_data *tree, int k));
-local void gen_bitlen     OF((deflate_state *s, tree_desc *desc));
+local unsigned *sort_freqs OF((unsigned *dst, unsigned *src, int count,
+                              unsigned max_freq));
+local void huff_lengths   OF((unsigned *a, int n));
 local void gen_codes      OF((ct_data *tree, int max_code, ushf *bl_count));
 local void build_tree     OF((deflate_state *s, tree_desc *desc));
 local void scan_tree      OF((deflate_state *s, ct_data *tree, int max_code));
@@ -146,8 +147,11 @@ local void send_tree      OF((deflate_state *s, ct_data *tree, int max_code));
 local int  build_bl_tree  OF((deflate_state *s));
 local void send_all_trees OF((deflate_state *s, int lcodes, int dcodes,
                               int blcodes));
+local void build_len_bits OF((deflate_state *s, const ct_data *ltree));
 local void compress_block OF((deflate_state *s, const ct_data *ltree,
                               const ct_data *dtree));
+local void compress_lits  OF((deflate_state *s, const ct_data *ltree,
+                              const uch *lits));
 local int  detect_data_type OF((deflate_state *s));
 local unsigned bi_reverse OF((unsigned code, int len));
 local void bi_windup      OF((deflate_state *s));
@@ -180,31 +184,31 @@ local void gen_trees_header OF((void));
 
 /* ===========================================================================
  * Send a value on a given number of bits.
- * IN assertion: length <= 16 and value fits in length bits.
+ * IN assertion: length <= 48 and value fits in length bits.
  */
 #ifdef ZLIB_DEBUG
-local void send_bits      OF((deflate_state *s, int value, int length));
+local void send_bits      OF((deflate_state *s, uint64_t value, int length));
 
 local void send_bits(s, value, length)
     deflate_state *s;
-    int value;  /* value to send */
-    int length; /* number of bits */
+    uint64_t value; /* value to send */
+    int length;     /* number of bits */
 {
-    Tracevv((stderr," l %2d v %4x ", length, value));
-    Assert(length > 0 && length <= 15, "invalid length");
+    Tracevv((stderr," l %2d v %4x ", length, (unsigned)value));
+    Assert(length > 0 && length <= 48, "invalid length");
     s->bits_sent += (ulg)length;
 
-    /* If not enough room in bi_buf, use (valid) bits from bi_buf and
-     * (16 - bi_valid) bits from value, leaving (width - (16 - bi_valid))
-     * unused bits in value.
+    /* If bi_buf would fill up, use (valid) bits from bi_buf and
+     * (64 - bi_valid) bits from value, leaving (width - (64 - bi_valid))
+     * unused bits in value. bi_valid is therefore always less than 64.
      */
-    if (s->bi_valid > (int)Buf_size - length) {
-        s->bi_buf |= (ush)value << s->bi_valid;
-        put_short(s, s->bi_buf);
-        s->bi_buf = (ush)value >> (Buf_size - s->bi_valid);
+    if (s->bi_valid >= (int)Buf_size - length) {
+        s->bi_buf |= (uint64_t)value << s->bi_valid;
+        put_uint64(s, s->bi_buf);
+        s->bi_buf = (uint64_t)value >> (Buf_size - s->bi_valid);
         s->bi_valid += length - Buf_size;
     } else {
-        s->bi_buf |= (ush)value << s->bi_valid;
+        s->bi_buf |= (uint64_t)value << s->bi_valid;
         s->bi_valid += length;
     }
 }
@@ -212,14 +216,14 @@ local void send_bits(s, value, length)
 
 #define send_bits(s, value, length) \
 { int len = length;\
-  if (s->bi_valid > (int)Buf_size - len) {\
-    int val = (int)value;\
-    s->bi_buf |= (ush)val << s->bi_valid;\
-    put_short(s, s->bi_buf);\
-    s->bi_buf = (ush)val >> (Buf_size - s->bi_valid);\
+  if (s->bi_valid >= (int)Buf_size - len) {\
+    uint64_t val = (uint64_t)(value);\
+    s->bi_buf |= val << s->bi_valid;\
+    put_uint64(s, s->bi_buf);\
+    s->bi_buf = val >> (Buf_size - s->bi_valid);\
     s->bi_valid += len - Buf_size;\
   } else {\
-    s->bi_buf |= (ush)(value) << s->bi_valid;\
+    s->bi_buf |= (uint64_t)(value) << s->bi_valid;\
     s->bi_valid += len;\
   }\
 }
@@ -419,147 +423,121 @@ local void init_block(s)
     s->dyn_ltree[END_BLOCK].Freq = 1;
     s->opt_len = s->static_len = 0L;
     s->sym_next = s->matches = 0;
-}
-
-#define SMALLEST 1
-/* Index within the heap array of least frequent node in the Huffman tree */
 
-
-/* ===========================================================================
- * Remove the smallest element from the heap and recreate the heap with
- * one less element. Updates heap and heap_len.
- */
-#define pqremove(s, tree, top) \
-{\
-    top = s->heap[SMALLEST]; \
-    s->heap[SMALLEST] = s->heap[s->heap_len--]; \
-    pqdownheap(s, tree, SMALLEST); \
+    for (n = 0; n < SPLIT_TYPES; n++) s->split_obs[n] = 0;
 }
 
 /* ===========================================================================
- * Compares to subtrees, using the tree depth as tie breaker when
- * the subtrees have equal frequency. This minimizes the worst case length.
- */
-#define smaller(tree, n, m, depth) \
-   (tree[n].Freq < tree[m].Freq || \
-   (tree[n].Freq == tree[m].Freq && depth[n] <= depth[m]))
-
-/* ===========================================================================
- * Restore the heap property by moving down the tree starting at node k,
- * exchanging a node with the smallest of its two sons if necessary, stopping
- * when the heap property is re-established (each father smaller than its
- * two sons).
+ * Sort the count keys in src by increasing frequency into dst. Each key is
+ * Freq << 16 | symbol, so ties are broken by symbol and the order is the
+ * same whichever sort is used. Small sets use an insertion sort, larger ones
+ * a stable radix sort on the bytes of Freq. Returns dst or src, whichever
+ * holds the result; the other one is free for use by the caller.
  */
-local void pqdownheap(s, tree, k)
-    deflate_state *s;
-    ct_data *tree;  /* the tree to restore */
-    int k;               /* node to move down */
+local unsigned *sort_freqs(dst, src, count, max_freq)
+    unsigned *dst;      /* output keys, also used as scratch */
+    unsigned *src;      /* input keys, also used as scratch */
+    int count;          /* number of keys */
+    unsigned max_freq;  /* largest frequency in src */
 {
-    int v = s->heap[k];
-    int j = k << 1;  /* left son of k */
-    while (j <= s->heap_len) {
-        /* Set j to the smallest of the two sons: */
-        if (j < s->heap_len &&
-            smaller(tree, s->heap[j + 1], s->heap[j], s->depth)) {
-            j++;
+    unsigned cnt[256];  /* bucket counts and then offsets */
+    unsigned key;       /* key being inserted */
+    unsigned *tmp;      /* to swap src and dst */
+    int shift;          /* position of the byte being sorted on */
+    int i, j;
+
+    if (count <= 32) {
+        for (i = 1; i < count; i++) {
+            key = src[i];
+            for (j = i; j > 0 && src[j - 1] > key; j--)
+                src[j] = src[j - 1];
+            src[j] = key;
         }
-        /* Exit if v is smaller than both sons */
-        if (smaller(tree, v, s->heap[j], s->depth)) break;
-
-        /* Exchange v with the smallest son */
-        s->heap[k] = s->heap[j];  k = j;
-
-        /* And continue down the tree, setting j to the left son of k */
-        j <<= 1;
+        return src;
     }
-    s->heap[k] = v;
+    for (shift = 16; shift < 32; shift += 8) {
+        zmemzero(cnt, sizeof(cnt));
+        for (i = 0; i < count; i++)
+            cnt[(src[i] >> shift) & 0xff]++;
+        for (i = 0, key = 0; i < 256; i++) {
+            j = (int)cnt[i];
+            cnt[i] = key;
+            key += (unsigned)j;
+        }
+        for (i = 0; i < count; i++)
+            dst[cnt[(src[i] >> shift) & 0xff]++] = src[i];
+        tmp = src, src = dst, dst = tmp;
+        if ((max_freq >> (shift - 8)) == 0)
+            break;              /* no higher byte to sort on */
+    }
+    return src;
 }
 
 /* ===========================================================================
- * Compute the optimal bit lengths for a tree and update the total bit length
- * for the current block.
- * IN assertion: the fields freq and dad are set, heap[heap_max] and
- *    above are the tree nodes sorted by increasing frequency.
- * OUT assertions: the field len is set to the optimal bit length, the
- *     array bl_count contains the frequencies for each bit length.
- *     The length opt_len is updated; static_len is also updated if stree is
- *     not null.
+ * Replace the weights in a[0..n-1], sorted by increasing weight, with the
+ * lengths of an optimal prefix code for them (unlimited in length). The
+ * lengths come out in non-increasing order. This is the in-place method of
+ * Moffat and Katajainen, "In-Place Calculation of Minimum-Redundancy Codes",
+ * 1995: the first pass combines the two lightest items as in Huffman's
+ * algorithm, but keeps internal nodes in the consumed part of a[] as parent
+ * pointers; the second pass turns those into depths; the third hands out
+ * leaf depths from the number of internal nodes at each depth.
+ * IN assertion: n >= 2.
  */
-local void gen_bitlen(s, desc)
-    deflate_state *s;
-    tree_desc *desc;    /* the tree descriptor */
+local void huff_lengths(a, n)
+    unsigned *a;    /* weights in, code lengths out */
+    int n;          /* number of weights */
 {
-    ct_data *tree        = desc->dyn_tree;
-    int max_code         = desc->max_code;
-    const ct_data *stree = desc->stat_desc->static_tree;
-    const intf *extra    = desc->stat_desc->extra_bits;
-    int base             = desc->stat_desc->extra_base;
-    int max_length       = desc->stat_desc->max_length;
-    int h;              /* heap index */
-    int n, m;           /* iterate over the tree elements */
-    int bits;           /* bit length */
-    int xbits;          /* extra bits */
-    ush f;              /* frequency */
-    int overflow = 0;   /* number of elements with bit length too large */
-
-    for (bits = 0; bits <= MAX_BITS; bits++) s->bl_count[bits] = 0;
-
-    /* In a first pass, compute the optimal bit lengths (which may
-     * overflow in the case of the bit length tree).
-     */
-    tree[s->heap[s->heap_max]].Len = 0; /* root of the heap */
-
-    for (h = s->heap_max + 1; h < HEAP_SIZE; h++) {
-        n = s->heap[h];
-        bits = tree[tree[n].Dad].Len + 1;
-        if (bits > max_length) bits = max_length, overflow++;
-        tree[n].Len = (ush)bits;
-        /* We overwrite tree[n].Dad which is no longer needed */
-
-        if (n > max_code) continue; /* not a leaf node */
-
-        s->bl_count[bits]++;
-        xbits = 0;
-        if (n >= base) xbits = extra[n - base];
-        f = tree[n].Freq;
-        s->opt_len += (ulg)f * (unsigned)(bits + xbits);
-        if (stree) s->static_len += (ulg)f * (unsigned)(stree[n].Len + xbits);
+    int root;       /* next internal node to use */
+    int leaf;       /* next leaf to use */
+    int next;       /* next internal node to create or set */
+    int avbl;       /* nodes available at the current depth */
+    int used;       /* internal nodes used at the current depth */
+    unsigned dpth;  /* current depth */
+
+    /* First pass, left to right, setting parent pointers */
+    a[0] += a[1];
+    root = 0;
+    leaf = 2;
+    for (next = 1; next < n - 1; next++) {
+        /* select first item for a pairing */
+        if (leaf >= n || a[root] < a[leaf]) {
+            a[next] = a[root];
+            a[root++] = (unsigned)next;
+        } else
+            a[next] = a[leaf++];
+
+        /* add on the second item */
+        if (leaf >= n || (root < next && a[root] < a[leaf])) {
+            a[next] += a[root];
+            a[root++] = (unsigned)next;
+        } else
+            a[next] += a[leaf++];
     }
-    if (overflow == 0) return;
 
-    Tracev((stderr,"\nbit length overflow\n"));
-    /* This happens for example on obj2 and pic of the Calgary corpus */
-
-    /* Find the first bit length which could increase: */
-    do {
-        bits = max_length - 1;
-        while (s->bl_count[bits] == 0) bits--;
-        s->bl_count[bits]--;        /* move one leaf down the tree */
-        s->bl_count[bits + 1] += 2; /* move one overflow item as its brother */
-        s->bl_count[max_length]--;
-        /* The brother of the overflow item also moves one step up,
-         * but this does not affect bl_count[max_length]
-         */
-        overflow -= 2;
-    } while (overflow > 0);
-
-    /* Now recompute all bit lengths, scanning in increasing frequency.
-     * h is still equal to HEAP_SIZE. (It is simpler to reconstruct all
-     * lengths instead of fixing only the wrong ones. This idea is taken
-     * from 'ar' written by Haruhiko Okumura.)
-     */
-    for (bits = max_length; bits != 0; bits--) {
-        n = s->bl_count[bits];
-        while (n != 0) {
-            m = s->heap[--h];
-            if (m > max_code) continue;
-            if ((unsigned) tree[m].Len != (unsigned) bits) {
-                Tracev((stderr,"code %d bits %d->%d\n", m, tree[m].Len, bits));
-                s->opt_len += ((ulg)bits - tree[m].Len) * tree[m].Freq;
-                tree[m].Len = (ush)bits;
-            }
-            n--;
+    /* Second pass, right to left, setting internal depths */
+    a[n - 2] = 0;
+    for (next = n - 3; next >= 0; next--)
+        a[next] = a[a[next]] + 1;
+
+    /* Third pass, right to left, setting leaf depths */
+    avbl = 1;
+    used = 0;
+    dpth = 0;
+    root = n - 2;
+    next = n - 1;
+    while (avbl > 0) {
+        while (root >= 0 && a[root] == dpth) {
+            used++;
+            root--;
+        }
+        while (avbl > used) {
+            a[next--] = dpth;
+            avbl--;
         }
+        avbl = 2 * used;
+        dpth++;
+        used = 0;
     }
 }
 
@@ -620,21 +598,27 @@ local void build_tree(s, desc)
 {
     ct_data *tree         = desc->dyn_tree;
     const ct_data *stree  = desc->stat_desc->static_tree;
+    const intf *extra     = desc->stat_desc->extra_bits;
+    int base              = desc->stat_desc->extra_base;
     int elems             = desc->stat_desc->elems;
-    int n, m;          /* iterate over heap elements */
-    int max_code = -1; /* largest code with non zero frequency */
-    int node;          /* new node being created */
-
-    /* Construct the initial heap, with least frequent element in
-     * heap[SMALLEST]. The sons of heap[n] are heap[2*n] and heap[2*n + 1].
-     * heap[0] is not used.
-     */
-    s->heap_len = 0, s->heap_max = HEAP_SIZE;
+    int max_length        = desc->stat_desc->max_length;
+    unsigned keys[L_CODES];  /* Freq << 16 | symbol, for sorting */
+    unsigned work[L_CODES];  /* sort scratch, then weights and lengths */
+    unsigned *sorted;        /* keys sorted by increasing frequency */
+    unsigned *len;           /* code lengths, in the order of sorted */
+    unsigned max_freq = 0;   /* largest frequency */
+    ulg total;               /* Kraft sum of the lengths, in max_length units */
+    int count = 0;           /* number of codes with non zero frequency */
+    int overflow = 0;        /* true if a length exceeded max_length */
+    int max_code = -1;       /* largest code with non zero frequency */
+    int n, i, bits, xbits;
+    int node;                /* code forced to be present */
 
     for (n = 0; n < elems; n++) {
         if (tree[n].Freq != 0) {
-            s->heap[++(s->heap_len)] = max_code = n;
-            s->depth[n] = 0;
+            keys[count++] = ((unsigned)tree[n].Freq << 16) | (unsigned)n;
+            if (tree[n].Freq > max_freq) max_freq = tree[n].Freq;
+            max_code = n;
         } else {
             tree[n].Len = 0;
         }
@@ -645,54 +629,74 @@ local void build_tree(s, desc)
      * possible code. So to avoid special checks later on we force at least
      * two codes of non zero frequency.
      */
-    while (s->heap_len < 2) {
-        node = s->heap[++(s->heap_len)] = (max_code < 2 ? ++max_code : 0);
+    while (count < 2) {
+        node = (max_code < 2 ? ++max_code : 0);
         tree[node].Freq = 1;
-        s->depth[node] = 0;
+        keys[count++] = (1U << 16) | (unsigned)node;
+        if (max_freq == 0) max_freq = 1;
         s->opt_len--; if (stree) s->static_len -= stree[node].Len;
         /* node is 0 or 1 so it does not have extra bits */
     }
     desc->max_code = max_code;
 
-    /* The elements heap[heap_len/2 + 1 .. heap_len] are leaves of the tree,
-     * establish sub-heaps of increasing lengths:
-     */
-    for (n = s->heap_len/2; n >= 1; n--) pqdownheap(s, tree, n);
+    /* Sort by frequency and compute the optimal, unlimited, code lengths */
+    sorted = sort_freqs(work, keys, count, max_freq);
+    len = sorted == keys ? work : keys;
+    for (i = 0; i < count; i++)
+        len[i] = sorted[i] >> 16;
+    huff_lengths(len, count);
 
-    /* Construct the Huffman tree by repeatedly combining the least two
-     * frequent nodes.
-     */
-    node = elems;              /* next internal node of the tree */
-    do {
-        pqremove(s, tree, n);  /* n = node of least frequency */
-        m = s->heap[SMALLEST]; /* m = node of next least frequency */
-
-        s->heap[--(s->heap_max)] = n; /* keep the nodes sorted by frequency */
-        s->heap[--(s->heap_max)] = m;
-
-        /* Create a new node father of n and m */
-        tree[node].Freq = tree[n].Freq + tree[m].Freq;
-        s->depth[node] = (uch)((s->depth[n] >= s->depth[m] ?
-                                s->depth[n] : s->depth[m]) + 1);
-        tree[n].Dad = tree[m].Dad = (ush)node;
-#ifdef DUMP_BL_TREE
-        if (tree == s->bl_tree) {
-            fprintf(stderr,"\nnode %d(%d), sons %d(%d) %d(%d)",
-                    node, tree[node].Freq, n, tree[n].Freq, m, tree[m].Freq);
+    for (bits = 0; bits <= MAX_BITS; bits++) s->bl_count[bits] = 0;
+    for (i = 0; i < count; i++) {
+        if (len[i] > (unsigned)max_length) {
+            len[i] = (unsigned)max_length;
+            overflow = 1;
         }
-#endif
-        /* and insert the new node in the heap */
-        s->heap[SMALLEST] = node++;
-        pqdownheap(s, tree, SMALLEST);
-
-    } while (s->heap_len >= 2);
+        s->bl_count[len[i]]++;
+    }
 
-    s->heap[--(s->heap_max)] = s->heap[SMALLEST];
+    if (overflow) {
+        Tracev((stderr,"\nbit length overflow\n"));
+        /* This happens for example on obj2 and pic of the Calgary corpus.
+         * Clamping the lengths left the code oversubscribed. Each step
+         * removes one leaf at max_length and splits the deepest shorter
+         * leaf into two leaves one bit longer, which lowers the Kraft sum by
+         * one unit, until the code is complete. Then hand the lengths out
+         * again in order of frequency. (It is simpler to reassign all
+         * lengths instead of fixing only the wrong ones. This idea is taken
+         * from 'ar' written by Haruhiko Okumura.)
+         */
+        total = 0;
+        for (bits = max_length; bits > 0; bits--)
+            total += (ulg)s->bl_count[bits] << (max_length - bits);
+        while (total > (1UL << max_length)) {
+            s->bl_count[max_length]--;
+            for (bits = max_length - 1; bits > 0; bits--) {
+                if (s->bl_count[bits] != 0) {
+                    s->bl_count[bits]--;
+                    s->bl_count[bits + 1] += 2;
+                    break;
+                }
+            }
+            total--;
+        }
+        i = 0;
+        for (bits = max_length; bits > 0; bits--) {
+            for (n = s->bl_count[bits]; n != 0; n--)
+                len[i++] = (unsigned)bits;
+        }
+    }
 
-    /* At this point, the fields freq and dad are set. We can now
-     * generate the bit lengths.
-     */
-    gen_bitlen(s, (tree_desc *)desc);
+    /* Set the lengths and update the total bit lengths for the block */
+    for (i = 0; i < count; i++) {
+        n = (int)(sorted[i] & 0xffff);
+        bits = (int)len[i];
+        tree[n].Len = (ush)bits;
+        xbits = 0;
+        if (n >= base) xbits = extra[n - base];
+        s->opt_len += (ulg)tree[n].Freq * (unsigned)(bits + xbits);
+        if (stree) s->static_len += (ulg)tree[n].Freq * (unsigned)(stree[n].Len + xbits);
+    }
 
     /* The field len is now set, we can generate the bit codes */
     gen_codes ((ct_data *)tree, max_code, s->bl_count);
@@ -950,7 +954,7 @@ void ZLIB_INTERNAL _tr_flush_block(s, buf, stored_len, last)
 
         Tracev((stderr, "\nopt %lu(%lu) stat %lu(%lu) stored %lu lit %u ",
                 opt_lenb, s->opt_len, static_lenb, s->static_len, stored_len,
-                s->sym_next / 3));
+                s->sym_next));
 
 #ifndef FORCE_STATIC
         if (static_lenb <= opt_lenb || s->strategy == Z_FIXED)
@@ -978,8 +982,11 @@ void ZLIB_INTERNAL _tr_flush_block(s, buf, stored_len, last)
 
     } else if (static_lenb == opt_lenb) {
         send_bits(s, (STATIC_TREES<<1) + last, 3);
-        compress_block(s, (const ct_data *)static_ltree,
-                       (const ct_data *)static_dtree);
+        if (buf != (char*)0 && stored_len == s->sym_next)
+            compress_lits(s, (const ct_data *)static_ltree, (const uch *)buf);
+        else
+            compress_block(s, (const ct_data *)static_ltree,
+                           (const ct_data *)static_dtree);
 #ifdef ZLIB_DEBUG
         s->compressed_len += 3 + s->static_len;
 #endif
@@ -987,8 +994,11 @@ void ZLIB_INTERNAL _tr_flush_block(s, buf, stored_len, last)
         send_bits(s, (DYN_TREES<<1) + last, 3);
         send_all_trees(s, s->l_desc.max_code + 1, s->d_desc.max_code + 1,
                        max_blindex + 1);
-        compress_block(s, (const ct_data *)s->dyn_ltree,
-                       (const ct_data *)s->dyn_dtree);
+        if (buf != (char*)0 && stored_len == s->sym_next)
+            compress_lits(s, (const ct_data *)s->dyn_ltree, (const uch *)buf);
+        else
+            compress_block(s, (const ct_data *)s->dyn_ltree,
+                           (const ct_data *)s->dyn_dtree);
 #ifdef ZLIB_DEBUG
         s->compressed_len += 3 + s->opt_len;
 #endif
@@ -1018,24 +1028,164 @@ int ZLIB_INTERNAL _tr_tally(s, dist, lc)
     unsigned dist;  /* distance of matched string */
     unsigned lc;    /* match length - MIN_MATCH or unmatched char (dist==0) */
 {
-    s->sym_buf[s->sym_next++] = (uch)dist;
-    s->sym_buf[s->sym_next++] = (uch)(dist >> 8);
-    s->sym_buf[s->sym_next++] = (uch)lc;
+    unsigned code;  /* distance code */
+
     if (dist == 0) {
         /* lc is the unmatched char */
+        s->sym_buf[s->sym_next++] = (uint32_t)lc << 16;
         s->dyn_ltree[lc].Freq++;
     } else {
         s->matches++;
         /* Here, lc is the match length - MIN_MATCH */
-        dist--;             /* dist = match distance - 1 */
-        Assert((ush)dist < (ush)MAX_DIST(s) &&
+        code = d_code(dist - 1);
+        Assert((ush)(dist - 1) < (ush)MAX_DIST(s) &&
                (ush)lc <= (ush)(MAX_MATCH-MIN_MATCH) &&
-               (ush)d_code(dist) < (ush)D_CODES,  "_tr_tally: bad match");
+               (ush)code < (ush)D_CODES,  "_tr_tally: bad match");
 
+        s->sym_buf[s->sym_next++] = dist | ((uint32_t)lc << 16) |
+                                    ((uint32_t)code << 24);
         s->dyn_ltree[_length_code[lc] + LITERALS + 1].Freq++;
-        s->dyn_dtree[d_code(dist)].Freq++;
+        s->dyn_dtree[code].Freq++;
+    }
+    return (s->sym_next == s->sym_end ||
+            ((s->sym_next & (SPLIT_CHECK - 1)) == 0 && _tr_split_block(s)));
+}
+
+/* ===========================================================================
+ * Save a run of len unmatched chars from buf and tally their frequencies, for
+ * deflate_huff() and deflate_rle(). The run must not take sym_next past
+ * sym_end or past the next multiple of SPLIT_CHECK. Return true if the
+ * current block must be flushed. For Z_HUFFMAN_ONLY, if the window always
+ * holds the whole block, the chars are not saved in sym_buf: the block then
+ * has literals only, and _tr_flush_block() sends them from the window with
+ * compress_lits().
+ */
+int ZLIB_INTERNAL _tr_tally_lits(s, buf, len)
+    deflate_state *s;
+    const Bytef *buf;
+    unsigned len;
+{
+    uint32_t *sym = s->sym_buf + s->sym_next;
+    unsigned n;
+
+    Assert(len <= s->sym_end - s->sym_next &&
+           len <= SPLIT_CHECK - (s->sym_next & (SPLIT_CHECK - 1)),
+           "_tr_tally_lits: run too long");
+    if (s->strategy != Z_HUFFMAN_ONLY ||
+        s->lit_bufsize > s->w_size - MIN_LOOKAHEAD)
+        for (n = 0; n < len; n++)
+            sym[n] = (uint32_t)buf[n] << 16;
+    for (n = 0; n < len; n++)
+        s->dyn_ltree[buf[n]].Freq++;
+    s->sym_next += len;
+    return (s->sym_next == s->sym_end ||
+            ((s->sym_next & (SPLIT_CHECK - 1)) == 0 && _tr_split_block(s)));
+}
+
+#define split_lit(c) ((((c) >> 5) & 6) | ((c) & 1))
+#define split_match(lc) (8 + ((lc) >= 9 - MIN_MATCH))
+/* Block splitting class of a literal byte and of a match length - MIN_MATCH.
+ * The literal classes use the two high bits, which roughly separate text
+ * from binary data, and the low bit.
+ */
+
+/* ===========================================================================
+ * Decide whether to end the current block early because the data has
+ * changed: called after every SPLIT_CHECK symbols, it compares the classes
+ * of those symbols with the classes of all the earlier symbols of the block.
+ * Return true if the block should be flushed now, so that its Huffman codes
+ * only have to fit the data before the change. This is the observation-based
+ * heuristic of libdeflate, except that the classes are counted from the
+ * literal/length frequencies so that tallying a symbol costs nothing extra.
+ * Early in a block, it also detects incompressible input and then sets
+ * s->incompressible instead.
+ */
+int ZLIB_INTERNAL _tr_split_block(s)
+    deflate_state *s;
+{
+    ulg block_length = (ulg)((long)s->strstart - s->block_start);
+    ulg num_obs = s->sym_next - SPLIT_CHECK;  /* symbols before the new ones */
+    ulg num_items = s->sym_next;
+    ulg expected, actual, delta, cutoff;
+    uInt split_new[SPLIT_TYPES]; /* classes of the new symbols */
+    uInt even, odd;             /* class sums */
+    int n, i;
+
+    /* Count the classes of all the symbols of the block. Each quarter of
+     * the literals makes up an even and an odd class. Match lengths below
+     * 9 have one length code each.
+     */
+    for (n = 0; n < LITERALS; n += 64) {
+        even = odd = 0;
+        for (i = n; i < n + 64; i += 2) {
+            even += s->dyn_ltree[i].Freq;
+            odd += s->dyn_ltree[i + 1].Freq;
+        }
+        split_new[split_lit(n)] = even;
+        split_new[split_lit(n + 1)] = odd;
+    }
+    for (even = 0, n = LITERALS + 1; n < LITERALS + 1 + 9 - MIN_MATCH; n++)
+        even += s->dyn_ltree[n].Freq;
+    for (odd = 0; n < L_CODES; n++)
+        odd += s->dyn_ltree[n].Freq;
+    split_new[split_match(0)] = even;
+    split_new[split_match(9 - MIN_MATCH)] = odd;
+
+    /* Keep only the new symbols, and add them to the block statistics */
+    for (n = 0; n < SPLIT_TYPES; n++) {
+        split_new[n] -= s->split_obs[n];
+        s->split_obs[n] += split_new[n];
+    }
+
+    /* Early in the block, check whether the input is incompressible: hardly
+     * any matches, which cover few bytes, and a flat literal histogram. Then
+     * drop the symbols, and deflate_fast() and deflate_slow() store the input
+     * of the block and the input that follows (see deflate_stored_run()).
+     */
+    if (num_items >= 2048 && num_items <= 8192 &&
+        s->split_obs[split_match(0)] + s->split_obs[split_match(9 - MIN_MATCH)]
+            < num_items >> 6 &&
+        block_length < num_items + (num_items >> 4) && s->block_start >= 0L &&
+        s->w_size >= 2 * STORED_RUN && s->lit_bufsize >= STORED_RUN &&
+        s->strategy != Z_HUFFMAN_ONLY && s->strategy != Z_RLE) {
+        ulg sumsq = 0, lits = 0;
+
+        for (n = 0; n < LITERALS; n++) {
+            sumsq += (ulg)s->dyn_ltree[n].Freq * s->dyn_ltree[n].Freq;
+            lits += s->dyn_ltree[n].Freq;
+        }
+        if (FLAT_HISTOGRAM(sumsq, lits)) {
+            Tracev((stderr, "\nincompressible at %lu symbols ", num_items));
+            s->incompressible = 1;
+            init_block(s);
+            return 0;
+        }
+    }
+
+    if (num_obs == 0 || block_length < SPLIT_MIN_LENGTH)
+        return 0;
+
+    /* Sum how far each class of the new symbols is from its share in the
+     * block, with both sides scaled to num_obs * SPLIT_CHECK.
+     */
+    delta = 0;
+    for (n = 0; n < SPLIT_TYPES; n++) {
+        expected = (ulg)(s->split_obs[n] - split_new[n]) * SPLIT_CHECK;
+        actual = (ulg)split_new[n] * num_obs;
+        delta += actual > expected ? actual - expected : expected - actual;
+    }
+    cutoff = SPLIT_CHECK * 200 / 512 * num_obs;
+    /* Require a larger difference for short blocks with few symbols, where
+     * the statistics are less reliable.
+     */
+    if (block_length < 10000 && num_items < 8192)
+        cutoff += cutoff * (8192 - num_items) / 8192;
+    /* Longer blocks are split more easily. */
+    if (delta + (block_length >> 12) * num_obs >= cutoff) {
+        Tracev((stderr, "\nsplit block at %lu symbols ", num_items));
+        return 1;
     }
-    return (s->sym_next == s->sym_end);
+    return 0;
 }
 
 /* ===========================================================================
@@ -1046,48 +1196,121 @@ local void compress_block(s, ltree, dtree)
     const ct_data *ltree; /* literal tree */
     const ct_data *dtree; /* distance tree */
 {
+    uint32_t sym;       /* symbol record from sym_buf */
     unsigned dist;      /* distance of matched string */
     int lc;             /* match length or unmatched char (if dist == 0) */
     unsigned sx = 0;    /* running index in sym_buf */
     unsigned code;      /* the code to send */
-    int extra;          /* number of extra bits to send */
+    uint64_t bits;      /* codes to send with their extra bits */
+    int bits_len;       /* number of bits in bits */
+    int n;              /* literals that may still join bits */
 
+    build_len_bits(s, ltree);
     if (s->sym_next != 0) do {
-        dist = s->sym_buf[sx++] & 0xff;
-        dist += (unsigned)(s->sym_buf[sx++] & 0xff) << 8;
-        lc = s->sym_buf[sx++];
+        sym = s->sym_buf[sx++];
+        dist = sym & 0xffff;
+        lc = (int)((sym >> 16) & 0xff);
         if (dist == 0) {
-            send_code(s, lc, ltree); /* send a literal byte */
+            /* Send a literal byte, together with up to two more literals
+             * that follow it, at most 45 bits.
+             */
+            bits = ltree[lc].Code;
+            bits_len = ltree[lc].Len;
             Tracecv(isgraph(lc), (stderr," '%c' ", lc));
+            for (n = 2; n && sx < s->sym_next; n--) {
+                sym = s->sym_buf[sx];
+                if ((sym & 0xffff) != 0)
+                    break;
+                sx++;
+                lc = (int)((sym >> 16) & 0xff);
+                bits |= (uint64_t)ltree[lc].Code << bits_len;
+                bits_len += ltree[lc].Len;
+                Tracecv(isgraph(lc), (stderr," '%c' ", lc));
+            }
+            send_bits(s, bits, bits_len);
         } else {
             /* Here, lc is the match length - MIN_MATCH */
-            code = _length_code[lc];
-            send_code(s, code + LITERALS + 1, ltree);   /* send length code */
-            extra = extra_lbits[code];
-            if (extra != 0) {
-                lc -= base_length[code];
-                send_bits(s, lc, extra);       /* send the extra length bits */
-            }
+            bits = s->len_bits[lc] & 0xffffff;
+            bits_len = (int)(s->len_bits[lc] >> 24);
             dist--; /* dist is now the match distance - 1 */
-            code = d_code(dist);
+            code = sym >> 24;   /* resolved by _tr_tally */
             Assert (code < D_CODES, "bad d_code");
 
-            send_code(s, code, dtree);       /* send the distance code */
-            extra = extra_dbits[code];
-            if (extra != 0) {
-                dist -= (unsigned)base_dist[code];
-                send_bits(s, dist, extra);   /* send the extra distance bits */
-            }
+            /* Append the distance code and its extra bits, and send the
+             * whole match, at most 48 bits, at once.
+             */
+            bits |= (uint64_t)(dtree[code].Code |
+                    ((dist - (unsigned)base_dist[code]) << dtree[code].Len)) << bits_len;
+            bits_len += dtree[code].Len + extra_dbits[code];
+            send_bits(s, bits, bits_len);
         } /* literal or match pair ? */
 
         /* Check that the overlay between pending_buf and sym_buf is ok: */
-        Assert(s->pending < s->lit_bufsize + sx, "pendingBuf overflow");
+        Assert(s->pending < s->lit_bufsize + 4 * sx, "pendingBuf overflow");
 
     } while (sx < s->sym_next);
 
     send_code(s, END_BLOCK, ltree);
 }
 
+/* ===========================================================================
+ * Send a block of sym_next literals, which are the input block lits itself,
+ * using the literal tree ltree. Three literals, at most 45 bits, are sent at
+ * once. sym_buf is not used, so deflate_huff() may leave it unwritten.
+ */
+local void compress_lits(s, ltree, lits)
+    deflate_state *s;
+    const ct_data *ltree; /* literal tree */
+    const uch *lits;      /* the literal bytes */
+{
+    unsigned n = s->sym_next;
+    uint64_t bits;      /* codes to send */
+    int bits_len;       /* number of bits in bits */
+
+    for (; n >= 3; n -= 3, lits += 3) {
+        bits = ltree[lits[0]].Code |
+               ((uint64_t)ltree[lits[1]].Code << ltree[lits[0]].Len);
+        bits_len = ltree[lits[0]].Len + ltree[lits[1]].Len;
+        bits |= (uint64_t)ltree[lits[2]].Code << bits_len;
+        bits_len += ltree[lits[2]].Len;
+        send_bits(s, bits, bits_len);
+    }
+    for (; n; n--, lits++)
+        send_code(s, *lits, ltree);
+    send_code(s, END_BLOCK, ltree);
+}
+
+/* ===========================================================================
+ * Fill s->len_bits with the code and extra bits for every match length,
+ * using the literal/length tree ltree, so that compress_block() needs a
+ * single lookup per length.
+ */
+local void build_len_bits(s, ltree)
+    deflate_state *s;
+    const ct_data *ltree; /* literal tree */
+{
+    int lc;             /* match length - MIN_MATCH */
+    unsigned code;      /* the length code */
+    unsigned len;       /* number of bits in the length code */
+
+    for (lc = 0; lc < MAX_MATCH-MIN_MATCH+1; lc++) {
+        code = _length_code[lc];
+        len = ltree[code + LITERALS + 1].Len;
+        if (len == 0 || len > MAX_BITS) {
+            /* not used in this block, or the scan_tree() guard after the
+             * last code in use */
+            s->len_bits[lc] = 0;
+            continue;
+        }
+        s->len_bits[lc] = ((len + extra_lbits[code]) << 24) |
+                          ltree[code + LITERALS + 1].Code;
+        /* base_length[] is not meaningful for the code without extra bits
+         * used for MAX_MATCH, so skip it when there are none */
+        if (extra_lbits[code] != 0)
+            s->len_bits[lc] |= (unsigned)(lc - base_length[code]) << len;
+    }
+}
+
 /* ===========================================================================
  * Check if the data type is TEXT or BINARY, using the following algorithm:
  * - TEXT if the two conditions below are satisfied:
@@ -1153,11 +1376,12 @@ local unsigned bi_reverse(code, len)
 local void bi_flush(s)
     deflate_state *s;
 {
-    if (s->bi_valid == 16) {
-        put_short(s, s->bi_buf);
-        s->bi_buf = 0;
-        s->bi_valid = 0;
-    } else if (s->bi_valid >= 8) {
+    while (s->bi_valid >= 16) {
+        put_short(s, (ush)s->bi_buf);
+        s->bi_buf >>= 16;
+        s->bi_valid -= 16;
+    }
+    if (s->bi_valid >= 8) {
         put_byte(s, (Byte)s->bi_buf);
         s->bi_buf >>= 8;
         s->bi_valid -= 8;
@@ -1170,10 +1394,16 @@ local void bi_flush(s)
 local void bi_windup(s)
     deflate_state *s;
 {
-    if (s->bi_valid > 8) {
-        put_short(s, s->bi_buf);
-    } else if (s->bi_valid > 0) {
-        put_byte(s, (Byte)s->bi_buf);
+    if (s->bi_valid > 56) {
+        put_uint64(s, s->bi_buf);
+    } else {
+        while (s->bi_valid > 8) {
+            put_short(s, (ush)s->bi_buf);
+            s->bi_buf >>= 16;
+            s->bi_valid -= 16;
+        }
+        if (s->bi_valid > 0)
+            put_byte(s, (Byte)s->bi_buf);
     }
     s->bi_buf = 0;
     s->bi_valid = 0;
@@ -33,7 +33,10 @@
 #  ifndef Z_SOLO
 #    define compress              z_compress
 #    define compress2             z_compress2
+#    define compressBatch         z_compressBatch
 #    define compressBound         z_compressBound
+#    define compressFit           z_compressFit
+#    define compressFitBound      z_compressFitBound
 #  endif
 #  define crc32                 z_crc32
 #  define crc32_combine         z_crc32_combine
@@ -43,9 +46,11 @@
 #  define crc32_combine_op      z_crc32_combine_op
 #  define crc32_z               z_crc32_z
 #  define deflate               z_deflate
+#  define deflateBatch          z_deflateBatch
 #  define deflateBound          z_deflateBound
 #  define deflateCopy           z_deflateCopy
 #  define deflateEnd            z_deflateEnd
+#  define deflateFreeDictionary z_deflateFreeDictionary
 #  define deflateGetDictionary  z_deflateGetDictionary
 #  define deflateInit           z_deflateInit
 #  define deflateInit2          z_deflateInit2
@@ -53,11 +58,14 @@
 #  define deflateInit_          z_deflateInit_
 #  define deflateParams         z_deflateParams
 #  define deflatePending        z_deflatePending
+#  define deflatePrepareDictionary z_deflatePrepareDictionary
 #  define deflatePrime          z_deflatePrime
+#  define deflateRate           z_deflateRate
 #  define deflateReset          z_deflateReset
 #  define deflateResetKeep      z_deflateResetKeep
 #  define deflateSetDictionary  z_deflateSetDictionary
 #  define deflateSetHeader      z_deflateSetHeader
+#  define deflateSetPreparedDictionary z_deflateSetPreparedDictionary
 #  define deflateTune           z_deflateTune
 #  define deflate_copyright     z_deflate_copyright
 #  define get_crc_table         z_get_crc_table
@@ -103,6 +111,7 @@
 #  endif
 #  define inflate               z_inflate
 #  define inflateBack           z_inflateBack
+#  define inflateBackBuffer     z_inflateBackBuffer
 #  define inflateBackEnd        z_inflateBackEnd
 #  define inflateBackInit       z_inflateBackInit
 #  define inflateBackInit_      z_inflateBackInit_
@@ -121,8 +130,10 @@
 #  define inflateReset2         z_inflateReset2
 #  define inflateResetKeep      z_inflateResetKeep
 #  define inflateSetDictionary  z_inflateSetDictionary
+#  define inflateSetPreparedDictionary z_inflateSetPreparedDictionary
 #  define inflateSync           z_inflateSync
 #  define inflateSyncPoint      z_inflateSyncPoint
+#  define inflateSyncScan       z_inflateSyncScan
 #  define inflateUndermine      z_inflateUndermine
 #  define inflateValidate       z_inflateValidate
 #  define inflate_copyright     z_inflate_copyright
@@ -274,12 +285,18 @@
 #endif
 
 /* The memory requirements for deflate are (in bytes):
-            (1 << (windowBits+2)) +  (1 << (memLevel+9))
- that is: 128K for windowBits=15  +  128K for memLevel = 8  (default values)
+            (1 << (windowBits+2)) +  (1 << (memLevel+9)) + (1 << (memLevel+6))
+ that is: 128K for windowBits=15  +  144K for memLevel = 8  (default values)
  plus a few kilobytes for small objects. For example, if you want to reduce
- the default memory requirements from 256K to 128K, compile with
+ the default memory requirements from 272K to 136K, compile with
      make CFLAGS="-O -DMAX_WBITS=14 -DMAX_MEM_LEVEL=7"
  Of course this will generally degrade compression (there's no free lunch).
+ Compiling with -DPOS32 adds (1 << (windowBits+1)) + (1 << (memLevel+8))
+ to avoid sliding the hash tables every (1 << windowBits) bytes.
+ Compiling with -DZLIB_DETERMINISTIC uses the same hash on all CPUs instead
+ of the crc32 instruction where SSE4.2 or ARMv8 CRC is available, so that
+ the compressed output does not depend on the CPU.  contrib/hashcheck
+ checks this.
 
    The memory requirements for inflate are (in bytes) 1 << windowBits
  that is, 32K for windowBits=15 (default value) plus about 7 kilobytes
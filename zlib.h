@@ -130,6 +130,12 @@ typedef struct gz_header_s {
 
 typedef gz_header FAR *gz_headerp;
 
+/*
+     Opaque dictionary prepared once by deflatePrepareDictionary() and then
+  attached to any number of deflate or inflate streams.
+*/
+typedef struct z_dict_s FAR *z_dictp;
+
 /*
      The application must update next_in and avail_in when avail_in has dropped
    to zero.  It must update next_out and avail_out when avail_out has dropped
@@ -198,6 +204,7 @@ typedef gz_header FAR *gz_headerp;
 #define Z_RLE                 3
 #define Z_FIXED               4
 #define Z_DEFAULT_STRATEGY    0
+#define Z_RSYNCABLE           8
 /* compression strategy; see deflateInit2() below for details */
 
 #define Z_BINARY   0
@@ -599,6 +606,14 @@ ZEXTERN int ZEXPORT deflateInit2 OF((z_streamp strm,
    Z_FIXED prevents the use of dynamic Huffman codes, allowing for a simpler
    decoder for special applications.
 
+     Z_RSYNCABLE can be or'ed with any of the strategies above.  deflate() then
+   picks reset points from a rolling hash of the input, on average every 64K,
+   and at each one does a Z_FULL_FLUSH, which forgets the match history.  The
+   reset points depend only on the nearby input, so a local change to the
+   input changes the compressed output only up to the next reset point that
+   both versions share.  This lets rsync and deduplicating stores reuse most
+   of the compressed data, at the cost of a slightly lower compression ratio.
+
      deflateInit2 returns Z_OK if success, Z_MEM_ERROR if there was not enough
    memory, Z_STREAM_ERROR if any parameter is invalid (such as an invalid
    method), or Z_VERSION_ERROR if the zlib library version (zlib_version) is
@@ -673,6 +688,46 @@ ZEXTERN int ZEXPORT deflateGetDictionary OF((z_streamp strm,
    stream state is inconsistent.
 */
 
+ZEXTERN int ZEXPORT deflatePrepareDictionary OF((z_streamp strm,
+                                                 const Bytef *dictionary,
+                                                 uInt  dictLength,
+                                                 z_dictp *dict));
+/*
+     Sets the dictionary like deflateSetDictionary, and in addition saves the
+   resulting window and hash tables in a prepared dictionary returned in
+   *dict.  The prepared dictionary can then be attached to other streams with
+   deflateSetPreparedDictionary, which only copies the saved state instead of
+   inserting every dictionary byte in the hash tables again, or with
+   inflateSetPreparedDictionary.  This pays off when the same dictionary is
+   used for many short streams.  strm must have just been initialized or
+   reset, and the prepared dictionary is allocated with its zalloc function.
+
+     deflatePrepareDictionary returns Z_OK if success, Z_MEM_ERROR if there
+   was not enough memory, or Z_STREAM_ERROR under the same conditions as
+   deflateSetDictionary, or if deflate has already processed data on strm.
+*/
+
+ZEXTERN int ZEXPORT deflateSetPreparedDictionary OF((z_streamp strm,
+                                                     z_dictp dict));
+/*
+     Initializes the compression dictionary from a prepared dictionary.  The
+   result is the same as calling deflateSetDictionary with the dictionary that
+   dict was prepared from.  This function must be called immediately after
+   deflateInit, deflateInit2 or deflateReset, and strm must use the same
+   windowBits and memLevel as the stream that prepared dict.  The compression
+   level and strategy may differ.  dict is not referenced after the call.
+
+     deflateSetPreparedDictionary returns Z_OK if success, or Z_STREAM_ERROR
+   if the stream state is inconsistent or does not match dict.
+*/
+
+ZEXTERN int ZEXPORT deflateFreeDictionary OF((z_dictp dict));
+/*
+     Frees a prepared dictionary with the zfree function of the stream that
+   prepared it.  Streams to which dict was attached do not need it anymore.
+   deflateFreeDictionary returns Z_OK, or Z_STREAM_ERROR if dict is Z_NULL.
+*/
+
 ZEXTERN int ZEXPORT deflateCopy OF((z_streamp dest,
                                     z_streamp source));
 /*
@@ -710,13 +765,17 @@ ZEXTERN int ZEXPORT deflateParams OF((z_streamp strm,
    interpretation of level and strategy is as in deflateInit2().  This can be
    used to switch between compression and straight copy of the input data, or
    to switch to a different kind of input data requiring a different strategy.
-   If the compression approach (which is a function of the level) or the
-   strategy is changed, and if there have been any deflate() calls since the
-   state was initialized or reset, then the input available so far is
-   compressed with the old level and strategy using deflate(strm, Z_BLOCK).
-   There are three approaches for the compression levels 0, 1..3, and 4..9
-   respectively.  The new level and strategy will take effect at the next call
-   of deflate().
+   There are five compression approaches: level 0, Z_HUFFMAN_ONLY, Z_RLE, and
+   the other strategies at levels 1..3 and at levels 4..9.  The new level and
+   strategy will take effect at the next call of deflate(), and apply to any
+   input not yet compressed, without ending the current deflate block.  Only
+   if the approach changes to or from level 0 or Z_HUFFMAN_ONLY, or to Z_RLE
+   while deflate is storing input that it found to be incompressible, or
+   rarely when a string waiting for the next match would end the block, and if
+   there have been any deflate() calls since the state was initialized or
+   reset, then the input available so far is compressed with the old level and
+   strategy using deflate(strm, Z_BLOCK).  This makes it cheap to change the
+   parameters frequently, for example to adapt them to the data as it goes.
 
      If a deflate(strm, Z_BLOCK) is performed by deflateParams(), and it does
    not have enough output space to complete, then the parameter change will not
@@ -751,12 +810,44 @@ ZEXTERN int ZEXPORT deflateTune OF((z_streamp strm,
    searching for the best matching string, and even then only by the most
    fanatic optimizer trying to squeeze out the last compressed bit for their
    specific input data.  Read the deflate.c source code for the meaning of the
-   max_lazy, good_length, nice_length, and max_chain parameters.
+   max_lazy, good_length, nice_length, and max_chain parameters.  At levels 4
+   through 9 max_chain is an upper bound: the chain length searched is lowered
+   while long searches rarely find longer matches, to no less than max_chain/16.
 
      deflateTune() can be called after deflateInit() or deflateInit2(), and
    returns Z_OK on success, or Z_STREAM_ERROR for an invalid deflate stream.
  */
 
+ZEXTERN int ZEXPORT deflateRate OF((z_streamp strm,
+                                    int rate));
+/*
+     Let deflate() choose the compression level and strategy so as to compress
+   at about rate megabytes (10^6 bytes) of input per second.  deflate() times
+   its compression and, after every 50 milliseconds of it, moves one step
+   down a ladder of level 0, Z_HUFFMAN_ONLY, Z_RLE and levels 1 through 9 if
+   it was slower than rate, or one step up if it was more than a quarter
+   faster than rate.  It does not move above level 1 while level 1
+   or a higher level shrinks the input by less than 3%.  Levels 1 through 9
+   use the strategy given to deflateInit2() or deflateParams(), and the ladder
+   starts at the current level and strategy.  A rate of zero stops the
+   adaptation, leaving the level and strategy that were reached.
+
+     The level and strategy are changed with deflateParams() at the end of a
+   deflate() call with Z_NO_FLUSH, which ends the current deflate block first
+   if the deflate function changes, as described there.  If the output buffer
+   cannot take that block, the change is retried after the next such call.
+   The time is that of the calling thread only, so streams compressed on
+   other threads do not slow down this one's measurement.  It is the processor
+   time of the thread where the system provides a clock for it, as POSIX
+   systems do.  Elsewhere, as on Windows, it is the elapsed time of each
+   deflate() call, which includes the time that other threads or processes
+   kept the thread waiting for a processor, so there the target should allow
+   for a busy machine.
+
+     deflateRate() returns Z_OK on success, or Z_STREAM_ERROR if the stream
+   state was inconsistent or rate was negative.
+*/
+
 ZEXTERN uLong ZEXPORT deflateBound OF((z_streamp strm,
                                        uLong sourceLen));
 /*
@@ -770,6 +861,38 @@ ZEXTERN uLong ZEXPORT deflateBound OF((z_streamp strm,
    to return Z_STREAM_END.  Note that it is possible for the compressed size to
    be larger than the value returned by deflateBound() if flush options other
    than Z_FINISH or Z_NO_FLUSH are used.
+
+     The bound is for the level and strategy at the time of the call.  It is
+   exact for level 0, which adds five bytes for every stored block of at least
+   the smaller of the window size and (256 << memLevel) - 5 bytes, and for
+   Z_HUFFMAN_ONLY, where the data may be split in blocks as short as 5000 or
+   (64 << memLevel) - 1 bytes that are stored at worst.  Z_RLE has the same
+   bound with the default windowBits and memLevel.  Otherwise the bound
+   allows for about 0.03% of expansion with the default windowBits and
+   memLevel, and 4% or 13% with other settings.
+*/
+
+ZEXTERN int ZEXPORT deflateBatch OF((z_streamp strm, unsigned count,
+                                     Bytef * const *dest, uLongf *destLen,
+                                     const Bytef * const *source,
+                                     const uLong *sourceLen, int *err));
+/*
+     Compress count independent buffers with one stream: source[i] holds
+   sourceLen[i] bytes, which are compressed into dest[i] as a complete zlib,
+   gzip or raw deflate stream, with the parameters of strm.  Upon entry,
+   destLen[i] is the size of dest[i], and upon exit the compressed length.
+   The stream is reset with deflateReset() before each buffer, so this saves
+   the allocations of deflateInit() and deflateEnd() for every buffer, and
+   the reset only clears the parts of the hash table that the previous short
+   buffer used.  As after deflateReset(), a dictionary does not carry over to
+   the buffers.  strm can be used for more batches or other deflate() calls
+   afterwards, and must eventually be freed with deflateEnd().
+
+     If err is not Z_NULL, err[i] is set to the result for buffer i: Z_OK, or
+   Z_BUF_ERROR if the compressed data did not fit in destLen[i] bytes.
+   deflateBatch returns Z_OK if all of the buffers were compressed, the first
+   error of a buffer otherwise, or Z_STREAM_ERROR if the stream state was
+   inconsistent or an array was Z_NULL.
 */
 
 ZEXTERN int ZEXPORT deflatePending OF((z_streamp strm,
@@ -921,6 +1044,16 @@ ZEXTERN int ZEXPORT inflateGetDictionary OF((z_streamp strm,
    stream state is inconsistent.
 */
 
+ZEXTERN int ZEXPORT inflateSetPreparedDictionary OF((z_streamp strm,
+                                                     z_dictp dict));
+/*
+     Same as inflateSetDictionary, using a dictionary prepared by
+   deflatePrepareDictionary.  The Adler-32 value of the dictionary is not
+   computed again, and only the last part of the dictionary that fit in the
+   window of the preparing stream is copied, which is all that its data can
+   refer to.  The return values are the same as for inflateSetDictionary.
+*/
+
 ZEXTERN int ZEXPORT inflateSync OF((z_streamp strm));
 /*
      Skips invalid compressed data until a possible full flush point (see above
@@ -940,6 +1073,24 @@ ZEXTERN int ZEXPORT inflateSync OF((z_streamp strm));
    input each time, until success or end of the input data.
 */
 
+ZEXTERN unsigned ZEXPORT inflateSyncScan OF((const Bytef *buf, z_size_t len,
+                                             z_size_t *points, unsigned max));
+/*
+     Searches buf[0..len-1] for the same 00 00 FF FF pattern as inflateSync,
+   and saves in points[] the offset just past each occurrence, which is where
+   inflateSync would leave next_in, for up to max occurrences.  This allows
+   all of the candidate full flush points in a buffer to be found in one pass,
+   for example to recover data after damaged parts of a large stream, or to
+   split a stream that was written with Z_FULL_FLUSH for parallel
+   decompression.  Raw inflate (see inflateInit2) can be started at any of the
+   points that is a full flush point.  No stream is needed.
+
+     inflateSyncScan returns the number of points saved.  If that is max, then
+   there may be more, and the search can be continued with the part of buf
+   after the last point.  As for inflateSync, not every occurrence of the
+   pattern is a flush point.
+*/
+
 ZEXTERN int ZEXPORT inflateCopy OF((z_streamp dest,
                                     z_streamp source));
 /*
@@ -1165,6 +1316,25 @@ ZEXTERN int ZEXPORT inflateBack OF((z_streamp strm,
    cannot return Z_OK.
 */
 
+ZEXTERN int ZEXPORT inflateBackBuffer OF((z_streamp strm,
+                                          unsigned char FAR *buf,
+                                          unsigned size));
+/*
+     Replaces the window provided to inflateBackInit() with buf[0..size-1],
+   where size is at least the window size given to inflateBackInit().  The
+   buffer then takes the place of the window for the following inflateBack()
+   calls: it is decoded into directly, used as the history for matches, and
+   passed to out() each time it is full, so out() may be given up to size
+   bytes at a time.  A large buffer means fewer calls of out() and more of the
+   data decoded by the fast decoding loop.  The same rules apply to buf as to
+   the window, and the window provided to inflateBackInit() is no longer used.
+   inflateBackBuffer() may be called after inflateBackInit() or between
+   inflateBack() calls.
+
+     inflateBackBuffer returns Z_OK on success, or Z_STREAM_ERROR if the stream
+   state was inconsistent, buf is Z_NULL, or size is less than the window size.
+*/
+
 ZEXTERN int ZEXPORT inflateBackEnd OF((z_streamp strm));
 /*
      All memory allocated by inflateBackInit() is freed.
@@ -1264,6 +1434,47 @@ ZEXTERN uLong ZEXPORT compressBound OF((uLong sourceLen));
    compress() or compress2() call to allocate the destination buffer.
 */
 
+ZEXTERN int ZEXPORT compressFit OF((Bytef *dest,   uLongf *destLen,
+                                    const Bytef *source, uLong sourceLen,
+                                    int level));
+/*
+     Same as compress2(), except that when the compressed data does not fit in
+   destLen bytes, the source is compressed again with level 0, which copies it
+   in stored blocks.  Then the destination buffer only needs to be as large as
+   the value returned by compressFitBound(sourceLen), which is somewhat less
+   than compressBound(sourceLen) and holds for any level, at the cost of a
+   second pass over incompressible data.
+
+     compressFit returns Z_OK if success, Z_MEM_ERROR if there was not enough
+   memory, Z_BUF_ERROR if there was not enough room in the output buffer even
+   for stored blocks, Z_STREAM_ERROR if the level parameter is invalid.
+*/
+
+ZEXTERN uLong ZEXPORT compressFitBound OF((uLong sourceLen));
+/*
+     compressFitBound() returns an upper bound on the compressed size after
+   compressFit() on sourceLen bytes, with any level.  This is 5 bytes per 32K
+   plus 11.
+*/
+
+ZEXTERN int ZEXPORT compressBatch OF((Bytef * const *dest, uLongf *destLen,
+                                      const Bytef * const *source,
+                                      const uLong *sourceLen, unsigned count,
+                                      int level, int threads, int *err));
+/*
+     Compress count independent buffers as compress2() would with level, each
+   source[i] of sourceLen[i] bytes into dest[i] of destLen[i] bytes, using
+   deflateBatch() with one deflate stream per thread.  With threads greater
+   than one, up to that many threads (at most 64) compress the buffers, the
+   calling thread being one of them, and each thread takes the next buffer
+   when it is done with one.  err is as for deflateBatch().
+
+     compressBatch returns Z_OK if all of the buffers were compressed,
+   Z_MEM_ERROR if there was not enough memory for any thread's stream,
+   Z_BUF_ERROR if the compressed data of a buffer did not fit, or
+   Z_STREAM_ERROR if the level parameter is invalid or an array was Z_NULL.
+*/
+
 ZEXTERN int ZEXPORT uncompress OF((Bytef *dest,   uLongf *destLen,
                                    const Bytef *source, uLong sourceLen));
 /*
@@ -1309,9 +1520,10 @@ ZEXTERN gzFile ZEXPORT gzopen OF((const char *path, const char *mode));
    but can also include a compression level ("wb9") or a strategy: 'f' for
    filtered data as in "wb6f", 'h' for Huffman-only compression as in "wb1h",
    'R' for run-length encoding as in "wb1R", or 'F' for fixed code compression
-   as in "wb9F".  (See the description of deflateInit2 for more information
-   about the strategy parameter.)  'T' will request transparent writing or
-   appending with no compression and not using the gzip format.
+   as in "wb9F".  'y' adds Z_RSYNCABLE to any of these, as in "wb6y".  (See
+   the description of deflateInit2 for more information about the strategy
+   parameter.)  'T' will request transparent writing or appending with no
+   compression and not using the gzip format.
 
      "a" can be used instead of "w" to request that the gzip stream that will
    be written be appended to the file.  "+" will result in an error, since
@@ -265,6 +265,23 @@ extern z_const char * const z_errmsg[10]; /* indexed by 2-zlib_error */
 #define ZFREE(strm, addr)  (*((strm)->zfree))((strm)->opaque, (voidpf)(addr))
 #define TRY_FREE(s, p) {if (p) ZFREE(s, p);}
 
+/* Prepared dictionary, see deflatePrepareDictionary(). It is allocated as one
+   block: the structure, then the deflate hash tables head and prev, then the
+   window bytes. */
+struct z_dict_s {
+    uLong dictid;       /* Adler-32 of the whole dictionary */
+    uInt length;        /* number of dictionary bytes kept in window */
+    Bytef *window;      /* last length bytes of the dictionary */
+    uInt w_bits;        /* log2 of the window size that prepared it */
+    uInt hash_bits;     /* log2 of the size of head */
+    voidpf head;        /* copy of deflate's head[] after the dictionary */
+    voidpf prev;        /* copy of deflate's prev[0..length-1] */
+    uInt ins_h;         /* deflate hash state after the dictionary */
+    uInt insert;        /* bytes at the end not yet inserted in the hash */
+    free_func zfree;    /* used to free the prepared dictionary */
+    voidpf opaque;      /* private data object passed to zfree */
+};
+
    /* Reverse the bytes in a 32-bit value. Use compiler intrinsics when
    possible to take advantage of hardware implementations. */
 #if defined(_WIN32) && (_MSC_VER >= 1300)